@@ -0,0 +1,486 @@
+/*
+  ==============================================================================
+
+    Command line benchmarks for the rhythm engine and the processor.
+
+    The Makefile isn't committed. Resave RhythmBenchmark.jucer in the
+    Projucer to generate Benchmarks/Builds/LinuxMakefile, with JUCE 6 in
+    JUCE/modules next to this repository and foleys_gui_magic taken from the
+    plugin's JuceLibraryCode. Then run make CONFIG=Release there and run the
+    binary from its build folder.
+
+    The run exits with an error if a check fails. The RealtimeCheck
+    configuration also hooks allocations and locks, and fails if processBlock
+    made any outside non-realtime mode.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "../../Source/OfflineRenderer.h"
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/RealtimeSafetyGuard.h"
+#include "../../Source/RhythmEngine.h"
+#include "../../Source/SyntheticPlayHead.h"
+
+//==============================================================================
+namespace
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 128;
+    const double bpm = 120.0;
+    const int numBlocks = 200000;
+
+    //Every lane enabled with a different pattern and a mix of straight and triplet rates
+    void setUpLanes(RhythmEngine& engine, int numLanes)
+    {
+        const double rates[] = { 0.25, 0.5, 1.0 / 3.0, 0.75 };
+
+        engine.setNumLanes(numLanes);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            engine.setLaneEnabled(lane, true);
+            engine.setLaneNote(lane, 36 + lane);
+            engine.setLaneStepLength(lane, rates[lane % numElementsInArray(rates)]);
+            engine.setLanePattern(lane, StepPattern::euclidean(3 + lane % 5, 8 + lane % 13));
+        }
+    }
+
+    void benchmarkLaneCount(int numLanes)
+    {
+        RhythmEngine engine;
+        engine.prepare(sampleRate);
+        setUpLanes(engine, numLanes);
+
+        auto samplesPerPpq = sampleRate * 60.0 / bpm;
+        int64 numEvents = 0;
+
+        auto start = Time::getHighResolutionTicks();
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            auto ppqPosition = (double) block * blockSize / samplesPerPpq;
+
+            engine.process(ppqPosition, bpm, blockSize, [&](const RhythmEngine::Event&) { ++numEvents; });
+        }
+
+        auto seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+        std::cout << String(numLanes).paddedLeft(' ', 5)
+                  << String(seconds * 1.0e9 / numBlocks, 1).paddedLeft(' ', 14)
+                  << String(numEvents).paddedLeft(' ', 12) << std::endl;
+    }
+
+    //Lane settings aren't always host parameters, so they are set through the processor
+    void setLaneParameter(SandysRhythmGeneratorAudioProcessor& processor, int lane, int field, float value)
+    {
+        auto* parameter = processor.getLaneParameter(lane, field);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    //Active lanes get different patterns at the given rate index, the rest are switched off
+    void setUpProcessorLanes(SandysRhythmGeneratorAudioProcessor& processor, int numActiveLanes, int rateIndex)
+    {
+        for (int lane = 0; lane < SandysRhythmGeneratorAudioProcessor::getRhythmCount(); ++lane)
+        {
+            setLaneParameter(processor, lane, 0, lane < numActiveLanes ? 1.0f : 0.0f);
+            setLaneParameter(processor, lane, 2, (float) (8 + lane % 13));
+            setLaneParameter(processor, lane, 3, (float) (3 + lane % 5));
+            setLaneParameter(processor, lane, 6, (float) rateIndex);
+        }
+    }
+
+    //Renders the whole plugin through its processBlock, every lane on with a different pattern
+    void benchmarkOfflineRender(int numBars)
+    {
+        auto processor = std::make_unique<SandysRhythmGeneratorAudioProcessor>();
+        setUpProcessorLanes(*processor, SandysRhythmGeneratorAudioProcessor::getRhythmCount(), 1);
+
+        OfflineRenderer::Settings settings;
+        settings.numBars = numBars;
+
+        auto result = OfflineRenderer::render(*processor, settings);
+
+        std::cout << "Offline render of " << numBars << " bars at " << settings.bpm << " bpm, "
+                  << settings.blockSize << " sample blocks: " << String(result.getBarsPerSecond(), 0)
+                  << " bars/s, " << result.numEvents << " events, "
+                  << String(processor->getTimingJitter().maxSamples, 3) << " samples timing jitter at most" << std::endl;
+    }
+
+    //==============================================================================
+    struct LaneConfiguration
+    {
+        const char* name;
+        int numActiveLanes;
+        int rateIndex;
+    };
+
+    //Times each processBlock call of a realtime processor, the way a host audio callback would drive it,
+    //returns false if the lanes set up played nothing
+    bool benchmarkProcessBlock(double blockSampleRate, int blockSamples, double blockBpm, const LaneConfiguration& lanes)
+    {
+        const double secondsOfAudio = 20.0;
+
+        auto processor = std::make_unique<SandysRhythmGeneratorAudioProcessor>();
+        setUpProcessorLanes(*processor, lanes.numActiveLanes, lanes.rateIndex);
+
+        SyntheticPlayHead playHead;
+        playHead.setSampleRate(blockSampleRate);
+        playHead.setTempo(blockBpm);
+
+        //Prepared and started offline, the first block publishes the lane setup itself as no timer runs here
+        processor->setPlayHead(&playHead);
+        processor->setRateAndBufferSizeDetails(blockSampleRate, blockSamples);
+        processor->setNonRealtime(true);
+        processor->prepareToPlay(blockSampleRate, blockSamples);
+
+        auto numChannels = jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+        AudioBuffer<float> buffer(numChannels, blockSamples);
+        MidiBuffer midiMessages;
+
+        processor->processBlock(buffer, midiMessages);
+        processor->setNonRealtime(false);
+
+        auto numBlocks = (int) (secondsOfAudio * blockSampleRate / blockSamples);
+        int64 numEvents = 0;
+        int64 totalTicks = 0;
+        int64 worstTicks = 0;
+
+        for (int block = 1; block <= numBlocks; ++block)
+        {
+            playHead.setPositionInSamples((int64) block * blockSamples);
+            midiMessages.clear();
+
+            auto start = Time::getHighResolutionTicks();
+            processor->processBlock(buffer, midiMessages);
+            auto elapsed = Time::getHighResolutionTicks() - start;
+
+            totalTicks += elapsed;
+            worstTicks = jmax(worstTicks, elapsed);
+            numEvents += midiMessages.getNumEvents();
+        }
+
+        processor->releaseResources();
+        processor->setPlayHead(nullptr);
+
+        std::cout << String(blockSampleRate, 0).paddedLeft(' ', 7)
+                  << String(blockSamples).paddedLeft(' ', 7)
+                  << String(blockBpm, 0).paddedLeft(' ', 6)
+                  << String(lanes.name).paddedLeft(' ', 14)
+                  << String(Time::highResolutionTicksToSeconds(totalTicks) * 1.0e9 / numBlocks, 1).paddedLeft(' ', 12)
+                  << String(Time::highResolutionTicksToSeconds(worstTicks) * 1.0e9, 1).paddedLeft(' ', 12)
+                  << String(numEvents).paddedLeft(' ', 10)
+                  << String(processor->getTimingJitter().maxSamples, 3).paddedLeft(' ', 10) << std::endl;
+
+        return numEvents > 0;
+    }
+
+    //==============================================================================
+    //Load time and size of the binary state against the ValueTree format it replaced
+    void benchmarkStateLoad(int numLoads)
+    {
+        auto processor = std::make_unique<SandysRhythmGeneratorAudioProcessor>();
+        setUpProcessorLanes(*processor, SandysRhythmGeneratorAudioProcessor::getRhythmCount(), 1);
+
+        MemoryBlock binaryState, valueTreeState;
+        processor->getStateInformation(binaryState);
+        processor->getValueTreeStateInformation(valueTreeState);
+
+        auto timeLoads = [&](const MemoryBlock& state)
+        {
+            auto start = Time::getHighResolutionTicks();
+
+            for (int load = 0; load < numLoads; ++load)
+                processor->setStateInformation(state.getData(), (int) state.getSize());
+
+            return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1.0e6 / numLoads;
+        };
+
+        std::cout << "State of " << SandysRhythmGeneratorAudioProcessor::getRhythmCount() << " lanes, "
+                  << numLoads << " loads each" << std::endl;
+
+        std::cout << "format        bytes     us/load" << std::endl;
+
+        std::cout << String("ValueTree").paddedRight(' ', 9)
+                  << String((int64) valueTreeState.getSize()).paddedLeft(' ', 9)
+                  << String(timeLoads(valueTreeState), 2).paddedLeft(' ', 12) << std::endl;
+
+        std::cout << String("Binary").paddedRight(' ', 9)
+                  << String((int64) binaryState.getSize()).paddedLeft(' ', 9)
+                  << String(timeLoads(binaryState), 2).paddedLeft(' ', 12) << std::endl;
+    }
+
+    //==============================================================================
+    //Loads a bank of numPrograms programs, then switches program before every block of a realtime run
+    void benchmarkProgramSwitch(int numPrograms)
+    {
+        const double switchSampleRate = 48000.0;
+        const int switchBlockSize = 128;
+        const int numSwitches = 20000;
+
+        auto processor = std::make_unique<SandysRhythmGeneratorAudioProcessor>();
+        auto numLanes = SandysRhythmGeneratorAudioProcessor::getRhythmCount();
+        auto numLaneFields = SandysRhythmGeneratorAudioProcessor::getParameterIDs(0).size();
+
+        Array<PresetBank::FieldKind> fieldKinds;
+        Array<float> defaults;
+
+        for (int field = 0; field < numLaneFields; ++field)
+        {
+            auto* parameter = processor->getLaneParameter(0, field);
+            fieldKinds.add(dynamic_cast<AudioParameterFloat*>(parameter) != nullptr ? PresetBank::unitField : PresetBank::integerField);
+            defaults.add(parameter->convertFrom0to1(parameter->getDefaultValue()));
+        }
+
+        //Every program plays all lanes with its own steps, pulses, rate and algorithm
+        Array<PresetBank::Program> programs;
+
+        for (int index = 0; index < numPrograms; ++index)
+        {
+            PresetBank::Program program;
+            program.name = "Program " + String(index + 1);
+
+            for (int lane = 0; lane < numLanes; ++lane)
+            {
+                auto fields = defaults;
+                fields.set(0, 1.0f);
+                fields.set(2, (float) (8 + (index + lane) % 9));
+                fields.set(3, (float) (1 + (index * 3 + lane) % 7));
+                fields.set(6, (float) ((index + lane) % 9));
+                fields.set(8, (float) (index % (int) RhythmAlgorithm::numAlgorithms));
+                fields.set(9, (float) (index % 128));
+                program.fields.addArray(fields);
+            }
+
+            programs.add(program);
+        }
+
+        TemporaryFile bankFile(".srgbank");
+        PresetBank::save(bankFile.getFile(), programs, numLanes, fieldKinds);
+
+        auto loadStart = Time::getHighResolutionTicks();
+        auto loaded = processor->loadPresetBank(bankFile.getFile());
+        auto loadSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - loadStart);
+
+        if (! loaded)
+        {
+            std::cout << "Could not load the preset bank" << std::endl;
+            return;
+        }
+
+        SyntheticPlayHead playHead;
+        playHead.setSampleRate(switchSampleRate);
+        playHead.setTempo(bpm);
+
+        processor->setPlayHead(&playHead);
+        processor->setRateAndBufferSizeDetails(switchSampleRate, switchBlockSize);
+        processor->prepareToPlay(switchSampleRate, switchBlockSize);
+
+        auto numChannels = jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+        AudioBuffer<float> buffer(numChannels, switchBlockSize);
+        MidiBuffer midiMessages;
+
+        int64 totalTicks = 0;
+        int64 worstTicks = 0;
+
+        for (int block = 0; block < numSwitches; ++block)
+        {
+            playHead.setPositionInSamples((int64) block * switchBlockSize);
+            midiMessages.clear();
+
+            auto start = Time::getHighResolutionTicks();
+            processor->setCurrentProgram(block % numPrograms);
+            processor->processBlock(buffer, midiMessages);
+            auto elapsed = Time::getHighResolutionTicks() - start;
+
+            totalTicks += elapsed;
+            worstTicks = jmax(worstTicks, elapsed);
+        }
+
+        processor->releaseResources();
+        processor->setPlayHead(nullptr);
+
+        std::cout << "Preset bank of " << numPrograms << " programs, " << bankFile.getFile().getSize() << " bytes, loaded in "
+                  << String(loadSeconds * 1.0e3, 2) << " ms" << std::endl;
+
+        std::cout << "Program switch and " << switchBlockSize << " sample block: "
+                  << String(Time::highResolutionTicksToSeconds(totalTicks) * 1.0e9 / numSwitches, 1) << " ns mean, "
+                  << String(Time::highResolutionTicksToSeconds(worstTicks) * 1.0e9, 1) << " ns worst" << std::endl;
+    }
+
+    //==============================================================================
+    //What the old mono input bus cost per block: a host filled buffer the processor had to clear
+    void benchmarkDummyInputBus(int blockSamples)
+    {
+        const int numRuns = 200000;
+
+        AudioBuffer<float> buffer(1, blockSamples);
+
+        auto start = Time::getHighResolutionTicks();
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            //The host writes its input into the buffer every block, so it is never already clear
+            buffer.setNotClear();
+            buffer.clear();
+        }
+
+        auto seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+        std::cout << String(blockSamples).paddedLeft(' ', 7)
+                  << String(seconds * 1.0e9 / numRuns, 1).paddedLeft(' ', 12)
+                  << String(blockSamples * (int) sizeof(float)).paddedLeft(' ', 10) << std::endl;
+    }
+
+    //==============================================================================
+    //Realtime blocks writing into a host buffer that was never reserved and already holds input,
+    //returns false if the guard caught anything while the output was merged into it or nothing was merged
+    bool checkUnreservedHostBuffer(int numBlocksToRun)
+    {
+        const double hostSampleRate = 48000.0;
+        const int hostBlockSize = 512;
+
+        auto processor = std::make_unique<SandysRhythmGeneratorAudioProcessor>();
+        setUpProcessorLanes(*processor, SandysRhythmGeneratorAudioProcessor::getRhythmCount(), 5);
+
+        SyntheticPlayHead playHead;
+        playHead.setSampleRate(hostSampleRate);
+        playHead.setTempo(bpm);
+
+        //The lane setup is published by an offline block into its own buffer, before anything is guarded,
+        //so the first realtime block meets the host's buffer unreserved
+        processor->setPlayHead(&playHead);
+        processor->setRateAndBufferSizeDetails(hostSampleRate, hostBlockSize);
+        processor->setNonRealtime(true);
+        processor->prepareToPlay(hostSampleRate, hostBlockSize);
+
+        auto numChannels = jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+        AudioBuffer<float> buffer(numChannels, hostBlockSize);
+
+        MidiBuffer setupMessages;
+        processor->processBlock(buffer, setupMessages);
+        processor->setNonRealtime(false);
+
+        MidiBuffer midiMessages;
+        auto violationsBefore = RealtimeSafetyGuard::getTotalNumViolations();
+        int64 numEvents = 0;
+
+        for (int block = 1; block <= numBlocksToRun; ++block)
+        {
+            playHead.setPositionInSamples((int64) block * hostBlockSize);
+
+            //Filled like a host would, outside the realtime section
+            midiMessages.clear();
+            midiMessages.addEvent(MidiMessage::controllerEvent(1, 1, block % 128), 0);
+            midiMessages.addEvent(MidiMessage::noteOn(1, 60, (uint8) 100), hostBlockSize / 4);
+            midiMessages.addEvent(MidiMessage::noteOff(1, 60), hostBlockSize / 2);
+
+            //With MIDI input off the input passes through, what is left over was written by the lanes
+            auto numInputEvents = midiMessages.getNumEvents();
+            processor->processBlock(buffer, midiMessages);
+            numEvents += midiMessages.getNumEvents() - numInputEvents;
+        }
+
+        processor->releaseResources();
+        processor->setPlayHead(nullptr);
+
+        auto violations = RealtimeSafetyGuard::getTotalNumViolations() - violationsBefore;
+
+        std::cout << "Unreserved host buffer with input, " << numBlocksToRun << " blocks of " << hostBlockSize << " samples: "
+                  << numEvents << " events written, " << processor->getNumDroppedEvents() << " dropped, "
+                  << violations << " realtime violations" << std::endl;
+
+        return violations == 0 && numEvents > 0 && processor->getNumDroppedEvents() == 0;
+    }
+
+    //==============================================================================
+    //Prints what the guard caught in realtime processBlock calls, returns false if there was anything
+    bool checkRealtimeSafety()
+    {
+        std::cout << std::endl << "Realtime safety of processBlock:";
+
+        for (int type = 0; type < RealtimeSafetyGuard::numViolationTypes; ++type)
+        {
+            auto violationType = (RealtimeSafetyGuard::ViolationType) type;
+            std::cout << " " << RealtimeSafetyGuard::getNumViolations(violationType) << " "
+                      << RealtimeSafetyGuard::getViolationName(violationType);
+        }
+
+        std::cout << std::endl;
+
+        for (auto& report : RealtimeSafetyGuard::getViolationReports())
+            std::cout << std::endl << report << std::endl;
+
+        return RealtimeSafetyGuard::getTotalNumViolations() == 0;
+    }
+}
+
+//==============================================================================
+int main(int, char*[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::cout << "Per block cost against lane count, " << blockSize << " samples at "
+              << sampleRate << " Hz, " << bpm << " bpm" << std::endl;
+
+    std::cout << "lanes      ns/block      events" << std::endl;
+
+    for (auto numLanes : { 1, 2, 4, 8, 16, 32, 64 })
+        benchmarkLaneCount(numLanes);
+
+    std::cout << std::endl << "processBlock cost, " << SandysRhythmGeneratorAudioProcessor::getRhythmCount()
+              << " lanes available" << std::endl;
+
+    //Jitter is how far the furthest step was emitted from its exact boundary, in samples
+    std::cout << "     Hz  block   bpm         lanes    ns/block    worst ns    events    jitter" << std::endl;
+
+    const LaneConfiguration laneConfigurations[] = { { "one 1/8",   1,  1 },
+                                                     { "all 1/8",   SandysRhythmGeneratorAudioProcessor::getRhythmCount(), 1 },
+                                                     { "all 1/16T", SandysRhythmGeneratorAudioProcessor::getRhythmCount(), 5 } };
+
+    //A configuration that played nothing timed nothing, which fails the run
+    auto everyConfigurationPlayed = true;
+
+    for (auto matrixSampleRate : { 44100.0, 48000.0, 96000.0 })
+        for (auto matrixBlockSize : { 32, 128, 512, 2048 })
+            for (auto matrixBpm : { 80.0, 120.0, 174.0 })
+                for (const auto& lanes : laneConfigurations)
+                    everyConfigurationPlayed &= benchmarkProcessBlock(matrixSampleRate, matrixBlockSize, matrixBpm, lanes);
+
+    if (! everyConfigurationPlayed)
+    {
+        std::cout << "processBlock played no events for a lane configuration" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << "Saved per block by dropping the mono input bus, "
+              << SandysRhythmGeneratorAudioProcessor().getTotalNumInputChannels() << " input channels now" << std::endl;
+
+    std::cout << "  block    ns/block     bytes" << std::endl;
+
+    for (auto busBlockSize : { 32, 128, 512, 2048 })
+        benchmarkDummyInputBus(busBlockSize);
+
+    std::cout << std::endl;
+    benchmarkOfflineRender(1000);
+
+    std::cout << std::endl;
+    benchmarkStateLoad(1000);
+
+    std::cout << std::endl;
+    benchmarkProgramSwitch(512);
+
+    std::cout << std::endl;
+    auto hostBufferPassed = checkUnreservedHostBuffer(1000);
+
+    //The RealtimeCheck configuration fails the run on any allocation or lock in processBlock
+    if (RealtimeSafetyGuard::isEnabled() && ! checkRealtimeSafety())
+        return 1;
+
+    if (! hostBufferPassed)
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+  ==============================================================================
+
+    BlockEpoch.h
+
+    Tells the message thread when the audio thread can no longer be reading
+    something that was replaced.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//==============================================================================
+/**
+    A counter the audio thread moves on when a block starts and again when it
+    ends, so it is odd while a block is running.
+
+    Whoever replaces something the audio thread picks up through a shared
+    pointer takes a stamp once nothing shared points at the old object any
+    more. Blocks starting after that can't find the old object, so it is safe
+    to free once the block running at the stamp, if any, has finished and the
+    audio thread doesn't still hold on to it from an earlier block.
+*/
+class BlockEpoch
+{
+public:
+    //Audio thread, for the length of one block
+    struct ScopedBlock
+    {
+        explicit ScopedBlock(BlockEpoch& e) noexcept : epoch(e) { ++epoch.counter; }
+        ~ScopedBlock() noexcept { ++epoch.counter; }
+
+        BlockEpoch& epoch;
+    };
+
+    //Message thread
+    uint32_t getStamp() const noexcept { return counter.load(); }
+
+    //True once no block that was running at the stamp is still running
+    bool hasPassed(uint32_t stamp) const noexcept
+    {
+        return (stamp & 1u) == 0 || counter.load() != stamp;
+    }
+
+private:
+    std::atomic<uint32_t> counter { 0 };
+};
@@ -0,0 +1,214 @@
+/*
+  ==============================================================================
+
+    BlockEventList.h
+
+    Fixed capacity store for the MIDI events of one block.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Collects the note ons and offs of a block in preallocated storage, then
+    sorts them once and merges them with whatever events the output MidiBuffer
+    already held.
+
+    The merge is written into a MidiBuffer reserved in prepare() and then
+    swapped with the host's buffer, so the output never grows the host's
+    storage on the audio thread. Both sides are already in time order, so the
+    merge appends every event straight to the buffer's data in one pass.
+
+    Swapping hands the host one of the reserved buffers and leaves its old
+    storage here. Hosts reuse the same buffer every block, so from the second
+    block on the storage coming back is the reserved one handed out before.
+    A second reserved buffer stands in for the host's own storage the first
+    time round, or whenever the host passes a different buffer.
+
+    At the same sample position note offs sort before note ons, so a lane
+    retriggering its note on the same sample never ends up silent.
+*/
+class BlockEventList
+{
+public:
+    //Room for incoming events on top of the generated ones when the merge storage is reserved
+    static constexpr int reservedInputEvents = 1024;
+
+    //Allocates room for maxEvents, call from prepareToPlay
+    void prepare(int maxEvents)
+    {
+        capacity = jmax(1, maxEvents);
+        entries.realloc((size_t) capacity);
+        sortScratch.realloc((size_t) capacity);
+        numEntries = 0;
+        numDropped.store(0, std::memory_order_relaxed);
+
+        reservedBytes = (size_t) ((capacity + reservedInputEvents) * maxEventSize);
+        merged.clear();
+        merged.ensureSize(reservedBytes);
+        spare.clear();
+        spare.ensureSize(reservedBytes);
+        spareIsReserved = true;
+        lastOutput = nullptr;
+    }
+
+    int getCapacity() const noexcept { return capacity; }
+
+    //Any thread, events that didn't fit since prepare()
+    int getNumDropped() const noexcept { return numDropped.load(std::memory_order_relaxed); }
+    int getNumEvents() const noexcept { return numEntries; }
+    void clear() noexcept { numEntries = 0; }
+
+    //Both return false without adding anything if the list is full, the event is counted as dropped
+    bool addNoteOn(int sampleOffset, int channel, int noteNumber, uint8 velocity) noexcept
+    {
+        return add(sampleOffset, true, (uint8) (0x90 | (channel - 1)), noteNumber, velocity);
+    }
+
+    bool addNoteOff(int sampleOffset, int channel, int noteNumber) noexcept
+    {
+        return add(sampleOffset, false, (uint8) (0x80 | (channel - 1)), noteNumber, 0);
+    }
+
+    //Sorts the collected events, merges them into the buffer and clears the list.
+    //Note ons and offs that were already in the buffer are dropped unless keepInputNotes is set
+    void sortAndAppendTo(MidiBuffer& buffer, bool keepInputNotes = true)
+    {
+        if (numEntries == 0 && (keepInputNotes || buffer.isEmpty()))
+            return;
+
+        sort();
+
+        //Only grows when the host sent more input than was reserved for
+        merged.clear();
+        merged.ensureSize(jmax(reservedBytes, (size_t) buffer.data.size() + (size_t) (numEntries * maxEventSize)));
+
+        auto entry = 0;
+
+        for (const auto metadata : buffer)
+        {
+            //Events already in the buffer stay ahead of ours at the same sample
+            for (; entry < numEntries && (int) (entries[entry].key >> 1) < metadata.samplePosition; ++entry)
+                addEntry(entries[entry]);
+
+            if (keepInputNotes || ! isNoteOnOrOff(metadata.data, metadata.numBytes))
+                append(metadata.data, metadata.numBytes, metadata.samplePosition);
+        }
+
+        for (; entry < numEntries; ++entry)
+            addEntry(entries[entry]);
+
+        buffer.swapWith(merged);
+        numEntries = 0;
+
+        //A buffer the output didn't go to last time hands back storage of unknown size, the spare takes its place
+        if (&buffer != lastOutput && spareIsReserved)
+        {
+            merged.swapWith(spare);
+            spareIsReserved = false;
+        }
+
+        lastOutput = &buffer;
+    }
+
+private:
+    struct Entry
+    {
+        uint32 key;     //Sample offset shifted up by one, the low bit set for note ons
+        uint8 bytes[3];
+    };
+
+    //A MidiBuffer stores an int32 sample position and a uint16 size before each message
+    static constexpr int headerSize = (int) (sizeof(int32) + sizeof(uint16));
+    static constexpr int maxEventSize = headerSize + 3;
+
+    bool add(int sampleOffset, bool isNoteOn, uint8 status, int noteNumber, uint8 velocity) noexcept
+    {
+        if (numEntries >= capacity)
+        {
+            numDropped.store(numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        jassert(sampleOffset >= 0);
+
+        auto& entry = entries[numEntries++];
+        entry.key = ((uint32) sampleOffset << 1) | (isNoteOn ? 1u : 0u);
+        entry.bytes[0] = status;
+        entry.bytes[1] = (uint8) jlimit(0, 127, noteNumber);
+        entry.bytes[2] = velocity;
+        return true;
+    }
+
+    //Lanes are emitted one after the other, so the list is far from sorted. A byte at a time radix sort is
+    //linear whatever the order, and only takes as many passes as the largest key has bytes
+    void sort() noexcept
+    {
+        uint32 largestKey = 0;
+
+        for (int i = 0; i < numEntries; ++i)
+            largestKey = jmax(largestKey, entries[i].key);
+
+        auto* source = entries.get();
+        auto* destination = sortScratch.get();
+
+        for (int shift = 0; shift < 32 && (largestKey >> shift) != 0; shift += 8)
+        {
+            int starts[257] = {};
+
+            for (int i = 0; i < numEntries; ++i)
+                ++starts[((source[i].key >> shift) & 0xff) + 1];
+
+            for (int digit = 0; digit < 256; ++digit)
+                starts[digit + 1] += starts[digit];
+
+            //Stable, so equal keys keep the order they were emitted in
+            for (int i = 0; i < numEntries; ++i)
+                destination[starts[(source[i].key >> shift) & 0xff]++] = source[i];
+
+            std::swap(source, destination);
+        }
+
+        if (source != entries.get())
+            std::copy(source, source + numEntries, entries.get());
+    }
+
+    void addEntry(const Entry& entry) noexcept
+    {
+        append(entry.bytes, 3, (int) (entry.key >> 1));
+    }
+
+    //Writes the event the way MidiBuffer lays it out, after everything already in the merge
+    void append(const uint8* bytes, int numBytes, int samplePosition) noexcept
+    {
+        uint8 header[headerSize];
+        writeUnaligned<int32>(header, (int32) samplePosition);
+        writeUnaligned<uint16>(header + sizeof(int32), (uint16) numBytes);
+
+        merged.data.addArray(header, headerSize);
+        merged.data.addArray(bytes, numBytes);
+    }
+
+    static bool isNoteOnOrOff(const uint8* bytes, int numBytes) noexcept
+    {
+        auto type = numBytes > 0 ? (bytes[0] & 0xf0) : 0;
+        return type == 0x80 || type == 0x90;
+    }
+
+    HeapBlock<Entry> entries;
+    HeapBlock<Entry> sortScratch;
+    int capacity = 0;
+    int numEntries = 0;
+    std::atomic<int> numDropped { 0 };
+
+    //Merge storage, both reserved in prepare()
+    MidiBuffer merged;
+    MidiBuffer spare;
+    size_t reservedBytes = 0;
+    bool spareIsReserved = false;
+    const MidiBuffer* lastOutput = nullptr;
+};
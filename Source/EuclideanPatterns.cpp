@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    EuclideanPatterns.cpp
+
+  ==============================================================================
+*/
+
+#include "EuclideanPatterns.h"
+
+//Built during static initialisation so the first processBlock doesn't pay for it
+const EuclideanPatterns EuclideanPatterns::table;
+
+EuclideanPatterns::EuclideanPatterns() noexcept
+{
+    for (int steps = 0; steps <= maxSteps; ++steps)
+        for (int pulses = 0; pulses <= maxSteps; ++pulses)
+            masks[pulses][steps] = generate(pulses, steps);
+}
+
+uint32_t EuclideanPatterns::get(int pulses, int steps) noexcept
+{
+    if (steps < 0)
+        steps = 0;
+    else if (steps > maxSteps)
+        steps = maxSteps;
+
+    if (pulses < 0)
+        pulses = 0;
+    else if (pulses > steps)
+        pulses = steps;
+
+    return table.masks[pulses][steps];
+}
+
+uint32_t EuclideanPatterns::generate(int pulses, int steps) noexcept
+{
+    if (steps <= 0)
+        return 0;
+
+    if (steps > maxSteps)
+        steps = maxSteps;
+
+    //We can only have as many beats as we have steps (0 <= beats <= steps)
+    if (pulses > steps)
+        pulses = steps;
+
+    if (pulses < 0)
+        pulses = 0;
+
+    //Same pairing as the string version, a sequence is a bit pattern plus its length
+    //and appending Y to X shifts Y past the end of X
+    uint64_t x = 1;
+    int x_length = 1;
+    int x_amount = pulses;
+
+    uint64_t y = 0;
+    int y_length = 1;
+    int y_amount = steps - pulses;
+
+    do
+    {
+        int x_temp = x_amount;
+        int y_temp = y_amount;
+        uint64_t y_copy = y;
+        int y_copy_length = y_length;
+
+        //Check which is the dominant pair
+        if (x_temp >= y_temp)
+        {
+            x_amount = y_temp;
+            y_amount = x_temp - y_temp;
+
+            //The previous dominant pair becomes the new non dominant pair
+            y = x;
+            y_length = x_length;
+        }
+        else
+        {
+            x_amount = x_temp;
+            y_amount = y_temp - x_temp;
+        }
+
+        //Create the new dominant pair by combining the previous pairs
+        x |= y_copy << x_length;
+        x_length += y_copy_length;
+    } while (x_amount > 1 && y_amount > 1);
+
+    uint64_t rhythm = 0;
+    int length = 0;
+
+    for (int i = 1; i <= x_amount; i++)
+    {
+        rhythm |= x << length;
+        length += x_length;
+    }
+
+    for (int i = 1; i <= y_amount; i++)
+    {
+        rhythm |= y << length;
+        length += y_length;
+    }
+
+    return static_cast<uint32_t>(rhythm);
+}
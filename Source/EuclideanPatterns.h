@@ -0,0 +1,44 @@
+/*
+  ==============================================================================
+
+    EuclideanPatterns.h
+
+    Table of every Euclidean rhythm in the plugin's parameter range, stored as
+    bitmasks so the audio thread never has to build a pattern.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/**
+    Holds one 32 bit mask per (pulses, steps) pair, bit n set when step n is a pulse.
+    The table is filled once when the plugin binary is loaded, so a lookup is a
+    single array read and never allocates.
+*/
+class EuclideanPatterns
+{
+public:
+    static constexpr int maxSteps = 32;
+
+    //Returns the pattern for the given pulses and steps, pulses are clamped to steps
+    static uint32_t get(int pulses, int steps) noexcept;
+
+    //Runs the Euclidean algorithm on bitmasks, used to fill the table
+    static uint32_t generate(int pulses, int steps) noexcept;
+
+    static bool isPulse(uint32_t pattern, int stepIndex) noexcept
+    {
+        return ((pattern >> stepIndex) & 1u) != 0;
+    }
+
+private:
+    EuclideanPatterns() noexcept;
+
+    uint32_t masks[maxSteps + 1][maxSteps + 1];
+
+    static const EuclideanPatterns table;
+};
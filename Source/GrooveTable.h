@@ -0,0 +1,45 @@
+/*
+  ==============================================================================
+
+    GrooveTable.h
+
+    Per step timing and velocity of a groove, compiled for the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/**
+    One entry per step of the groove cycle. Timing is a fraction of the lane's
+    step, so the same groove fits every rate, and velocity scales the lane's
+    velocity. The engine indexes it with the lane's absolute step number, so
+    applying a groove is a single lookup per step.
+
+    Timing offsets stay within maxOffset of a step, so grooved steps never
+    swap places.
+*/
+struct GrooveTable
+{
+    static constexpr int maxSteps = 128;
+    static constexpr double maxOffset = 0.45;
+
+    GrooveTable() noexcept
+    {
+        for (auto& scale : velocity)
+            scale = 1.0;
+    }
+
+    int length = 1;
+    double timing[maxSteps] = {};
+    double velocity[maxSteps];
+
+    int getIndex(int64_t step) const noexcept
+    {
+        auto index = static_cast<int>(step % length);
+        return index < 0 ? index + length : index;
+    }
+};
@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    GrooveTemplate.cpp
+
+  ==============================================================================
+*/
+
+#include "GrooveTemplate.h"
+
+GrooveTemplate GrooveTemplate::fromText(const String& text)
+{
+    GrooveTemplate groove;
+
+    for (auto line : StringArray::fromLines(text))
+    {
+        line = line.upToFirstOccurrenceOf("#", false, false).trim();
+
+        if (line.isEmpty())
+            continue;
+
+        auto tokens = StringArray::fromTokens(line, " \t,;", {});
+        tokens.removeEmptyStrings();
+
+        Step step;
+        step.timing = tokens[0].getDoubleValue();
+        step.velocity = tokens.size() > 1 ? tokens[1].getDoubleValue() : 1.0;
+
+        if (groove.steps.size() < maxSteps)
+            groove.steps.add(step);
+    }
+
+    return groove;
+}
+
+String GrooveTemplate::toText() const
+{
+    String text;
+
+    for (auto& step : steps)
+        text << String(step.timing, 4) << " " << String(step.velocity, 4) << newLine;
+
+    return text;
+}
+
+StringArray GrooveTemplate::getPresetNames()
+{
+    return { "Straight", "Push", "Laid back", "MPC 16" };
+}
+
+GrooveTemplate GrooveTemplate::getPreset(int index)
+{
+    static const char* const presets[] =
+    {
+        "0 1",
+        "0 1 \n -0.06 0.8 \n -0.03 0.9 \n -0.06 0.8",
+        "0 1 \n 0.08 0.75 \n 0.04 0.9 \n 0.1 0.75",
+        "0 1 \n 0.12 0.65 \n 0 0.85 \n 0.12 0.65"
+    };
+
+    return fromText(presets[jlimit(0, numElementsInArray(presets) - 1, index)]);
+}
+
+GrooveTable GrooveTemplate::compile(double swing) const noexcept
+{
+    GrooveTable table;
+
+    auto numSteps = jmax(1, steps.size());
+
+    //Swing needs a cycle of even length to know which steps are the off beats
+    table.length = swing > 0.0 && (numSteps & 1) != 0 ? numSteps * 2 : numSteps;
+    jassert(table.length <= GrooveTable::maxSteps);
+    table.length = jmin(table.length, GrooveTable::maxSteps);
+
+    auto swingOffset = jlimit(0.0, 1.0, swing) / 3.0;
+
+    for (int i = 0; i < table.length; ++i)
+    {
+        auto step = steps.isEmpty() ? Step() : steps.getReference(i % steps.size());
+        auto timing = step.timing + ((i & 1) != 0 ? swingOffset : 0.0);
+
+        table.timing[i] = jlimit(-GrooveTable::maxOffset, GrooveTable::maxOffset, timing);
+        table.velocity[i] = jlimit(0.0, 2.0, step.velocity);
+    }
+
+    return table;
+}
@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    GrooveTemplate.h
+
+    Groove templates as edited and saved, compiled into GrooveTables.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "GrooveTable.h"
+
+//==============================================================================
+/**
+    A cycle of per step timing offsets and velocity scales.
+
+    Templates are written as text, one step per line with its timing as a
+    fraction of a step and an optional velocity scale, '#' starts a comment:
+
+        # laid back hats
+        0.0   1.0
+        0.08  0.7
+
+    Compiling folds the swing amount in and produces the table the engine
+    reads, which only happens when the template or the swing changes.
+*/
+class GrooveTemplate
+{
+public:
+    struct Step
+    {
+        double timing = 0.0;
+        double velocity = 1.0;
+    };
+
+    //A table holds twice as many steps, so an odd length doubled for swing always fits
+    static constexpr int maxSteps = GrooveTable::maxSteps / 2;
+
+    GrooveTemplate() = default;
+
+    static GrooveTemplate fromText(const String& text);
+    String toText() const;
+
+    //The templates offered by the Groove parameter, in its order, without the custom one
+    static StringArray getPresetNames();
+    static GrooveTemplate getPreset(int index);
+
+    //Swing from 0 to 1 delays every second step, by up to a third of a step for a triplet feel
+    GrooveTable compile(double swing) const noexcept;
+
+    bool isEmpty() const noexcept { return steps.isEmpty(); }
+
+private:
+    Array<Step> steps;
+};
@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    InternalClock.h
+
+    Sample counting transport that runs with or without the host.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Counts samples from an anchor point and turns them into a ppq position at
+    the current tempo. Positions are always computed from the anchor instead of
+    being accumulated block by block, so the clock doesn't drift however long
+    it runs.
+
+    While the host transport is playing, the clock follows its tempo and pulls
+    its phase toward the host position by a fraction of a sample per block,
+    which stays under the half sample the StepScheduler treats as a jump. Only
+    an error bigger than resyncThresholdSamples, like the host starting or
+    seeking, makes it jump straight to the host position.
+*/
+class InternalClock
+{
+public:
+    struct Position
+    {
+        double ppqPosition = 0.0;
+        double bpm = 120.0;
+        bool isLockedToHost = false;
+    };
+
+    void prepare(double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    //Restarts the clock from ppq 0 and drops the host lock
+    void reset() noexcept
+    {
+        samplePosition = 0;
+        anchorSample = 0;
+        anchorPpq = 0.0;
+        locked = false;
+    }
+
+    //Tempo used while the host transport isn't playing
+    void setTempo(double newBpm) noexcept
+    {
+        if (newBpm > 0.0)
+            internalBpm = newBpm;
+    }
+
+    //Returns the position at the start of the block and moves on by numSamples.
+    //hostPosition may be null when there is no playhead.
+    Position advance(const AudioPlayHead::CurrentPositionInfo* hostPosition, int numSamples) noexcept
+    {
+        auto hostIsPlaying = hostPosition != nullptr && hostPosition->isPlaying && hostPosition->bpm > 0.0;
+        auto bpm = hostIsPlaying ? hostPosition->bpm : internalBpm;
+
+        if (bpm != currentBpm)
+        {
+            anchorPpq = getPpqAt(samplePosition);
+            anchorSample = samplePosition;
+            currentBpm = bpm;
+        }
+
+        if (hostIsPlaying)
+        {
+            auto samplesPerPpq = sampleRate * 60.0 / currentBpm;
+            auto errorSamples = (hostPosition->ppqPosition - getPpqAt(samplePosition)) * samplesPerPpq;
+
+            if (! locked || std::abs(errorSamples) > resyncThresholdSamples)
+            {
+                anchorPpq = hostPosition->ppqPosition;
+                anchorSample = samplePosition;
+            }
+            else
+            {
+                anchorPpq += jlimit(-maxSlewSamples, maxSlewSamples, errorSamples * lockGain) / samplesPerPpq;
+            }
+        }
+
+        locked = hostIsPlaying;
+
+        Position position { getPpqAt(samplePosition), currentBpm, locked };
+        samplePosition += numSamples;
+        return position;
+    }
+
+private:
+    static constexpr double resyncThresholdSamples = 64.0;
+    static constexpr double maxSlewSamples = 0.25;
+    static constexpr double lockGain = 0.1;
+
+    double getPpqAt(int64 sample) const noexcept
+    {
+        return anchorPpq + (double) (sample - anchorSample) * currentBpm / (60.0 * sampleRate);
+    }
+
+    double sampleRate = 44100.0;
+    double internalBpm = 120.0;
+    double currentBpm = 120.0;
+
+    int64 samplePosition = 0;
+    int64 anchorSample = 0;
+    double anchorPpq = 0.0;
+    bool locked = false;
+};
@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    LaneRandom.h
+
+    Small deterministic random generator held in every lane's state.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/**
+    PCG32 with a separate stream per lane. A lane reseeds it from the session
+    seed and the step it syncs to, so the same session played from the same
+    position always makes the same choices, offline or live. It has no heap
+    state and never touches the system's entropy source.
+*/
+class LaneRandom
+{
+public:
+    void seed(uint64_t sessionSeed, int lane, int64_t step) noexcept
+    {
+        increment = (static_cast<uint64_t>(lane) << 1) | 1u;
+        state = 0;
+        next();
+        state += sessionSeed ^ (static_cast<uint64_t>(step) * 0x9E3779B97F4A7C15ull);
+        next();
+    }
+
+    uint32_t next() noexcept
+    {
+        auto oldState = state;
+        state = oldState * 6364136223846793005ull + increment;
+
+        auto xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+        auto rotation = static_cast<uint32_t>(oldState >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+    }
+
+private:
+    uint64_t state = 0x853c49e6748fea9bull;
+    uint64_t increment = 0xda3e39cb94b95bdbull;
+};
@@ -0,0 +1,56 @@
+/*
+  ==============================================================================
+
+    LaneSnapshot.h
+
+    Immutable copy of every lane's configuration, built on the message thread
+    and handed to the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "GrooveTable.h"
+#include "StepPattern.h"
+
+//==============================================================================
+//Everything the engine needs to play one lane, pattern already generated
+struct LaneConfig
+{
+    bool enabled = false;
+    int noteNumber = 36;
+    double stepLengthPpq = 0.5;
+    double gateLength = 0.5;
+    StepPattern pattern;
+
+    //Chance of a pulse playing, its velocity and how much off beat pulses are softened
+    double probability = 1.0;
+    int velocity = 127;
+    double accent = 0.0;
+
+    //Position between the lane's pattern and its morph target, 0 to 1
+    double morph = 0.0;
+    StepPattern morphTarget;
+
+    //Pulses actually played when the parameter asked for more pulses than steps, otherwise 0
+    int clampedPulses = 0;
+};
+
+//==============================================================================
+struct LaneSnapshot
+{
+    static constexpr int maxLanes = 64;
+
+    int numLanes = 0;
+    LaneConfig lanes[maxLanes];
+
+    //Saved with the session, so probabilities play out the same way every time
+    uint64_t randomSeed = 0;
+
+    //Shared by all lanes, swing already folded in
+    GrooveTable groove;
+
+    //Bars for a lane to morph all the way across, 0 jumps straight to the new amount
+    double morphLengthBars = 0.0;
+};
@@ -0,0 +1,114 @@
+/*
+  ==============================================================================
+
+    MidiInputControl.h
+
+    Turns incoming notes into transposition, retriggers or gating of the lanes.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "RhythmEngine.h"
+
+//==============================================================================
+/**
+    Reads the note ons and offs the host sends in and applies them to the
+    engine. The processor splits the block at every note that changes
+    something, so the change lands on the sample the note arrived on.
+
+    Thru leaves the engine alone and passes the notes on, every other mode
+    consumes them.
+*/
+class MidiInputControl
+{
+public:
+    enum class Mode
+    {
+        thru,           //Input notes are passed on untouched
+        transpose,      //The last note played shifts every lane by its distance from the root note
+        retrigger,      //Every note on restarts all lanes from their first step
+        gate            //Lanes only play while a note is held
+    };
+
+    static StringArray getModeNames()
+    {
+        return { "Thru", "Transpose", "Retrigger", "Gate" };
+    }
+
+    //Call at the start of every block, before any of its notes are handled
+    void beginBlock(Mode newMode, int newRootNote, RhythmEngine& engine) noexcept
+    {
+        if (newMode != mode)
+        {
+            transpose = 0;
+            heldNotes[0] = heldNotes[1] = 0;
+        }
+
+        mode = newMode;
+        rootNote = newRootNote;
+
+        engine.setTranspose(mode == Mode::transpose ? transpose : 0);
+        engine.setGateOpen(mode != Mode::gate || isAnyNoteHeld());
+    }
+
+    bool consumesNotes() const noexcept { return mode != Mode::thru; }
+
+    //True if the message is a note that changes the engine in the current mode
+    bool isControlMessage(const uint8* data, int numBytes) const noexcept
+    {
+        if (mode == Mode::thru || numBytes < 3)
+            return false;
+
+        auto type = data[0] & 0xf0;
+        auto isNoteOn = type == 0x90 && data[2] > 0;
+        auto isNoteOff = type == 0x80 || (type == 0x90 && data[2] == 0);
+
+        return isNoteOn || (mode == Mode::gate && isNoteOff);
+    }
+
+    void handle(const uint8* data, int numBytes, RhythmEngine& engine) noexcept
+    {
+        if (! isControlMessage(data, numBytes))
+            return;
+
+        auto noteNumber = data[1] & 0x7f;
+        auto isNoteOn = (data[0] & 0xf0) == 0x90 && data[2] > 0;
+
+        switch (mode)
+        {
+            case Mode::transpose:
+                transpose = noteNumber - rootNote;
+                engine.setTranspose(transpose);
+                break;
+
+            case Mode::retrigger:
+                engine.retrigger();
+                break;
+
+            case Mode::gate:
+                if (isNoteOn)
+                    heldNotes[noteNumber >> 6] |= uint64(1) << (noteNumber & 63);
+                else
+                    heldNotes[noteNumber >> 6] &= ~(uint64(1) << (noteNumber & 63));
+
+                engine.setGateOpen(isAnyNoteHeld());
+                break;
+
+            case Mode::thru:
+            default:
+                break;
+        }
+    }
+
+private:
+    bool isAnyNoteHeld() const noexcept { return (heldNotes[0] | heldNotes[1]) != 0; }
+
+    Mode mode = Mode::thru;
+    int rootNote = 60;
+    int transpose = 0;
+    uint64 heldNotes[2] = {};
+};
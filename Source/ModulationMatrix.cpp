@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    ModulationMatrix.cpp
+
+  ==============================================================================
+*/
+
+#include "ModulationMatrix.h"
+
+#include <cmath>
+
+double ModulationMatrix::Range::convertTo0to1(double value) const noexcept
+{
+    auto proportion = end > start ? (value - start) / (end - start) : 0.0;
+    proportion = proportion < 0.0 ? 0.0 : (proportion > 1.0 ? 1.0 : proportion);
+
+    return skew == 1.0 ? proportion : std::pow(proportion, skew);
+}
+
+double ModulationMatrix::Range::convertFrom0to1(double proportion) const noexcept
+{
+    proportion = proportion < 0.0 ? 0.0 : (proportion > 1.0 ? 1.0 : proportion);
+
+    if (skew != 1.0 && proportion > 0.0)
+        proportion = std::exp(std::log(proportion) / skew);
+
+    return start + (end - start) * proportion;
+}
+
+double ModulationMatrix::modulate(double value, double offset, Destination destination) const noexcept
+{
+    const auto& range = ranges[destination];
+    return range.convertFrom0to1(range.convertTo0to1(value) + offset);
+}
+
+void ModulationMatrix::clear() noexcept
+{
+    numSlots = 0;
+    lanes = 0;
+}
+
+bool ModulationMatrix::addSlot(Slot slot) noexcept
+{
+    if (numSlots == maxSlots
+        || slot.macro < 0 || slot.macro >= numMacros
+        || slot.lane < 0 || slot.lane >= LaneSnapshot::maxLanes
+        || slot.destination < 0 || slot.destination >= numDestinations)
+        return false;
+
+    slot.depth = slot.depth < -1.0 ? -1.0 : (slot.depth > 1.0 ? 1.0 : slot.depth);
+
+    slots[numSlots++] = slot;
+    lanes |= uint64_t(1) << slot.lane;
+    return true;
+}
+
+void ModulationMatrix::apply(const float* macroValues, const LaneSnapshot& base, uint64_t lanesToApply, RhythmEngine& engine) const noexcept
+{
+    double offsets[LaneSnapshot::maxLanes][numDestinations];
+
+    for (int lane = 0; lane < base.numLanes; ++lane)
+        if (((lanesToApply >> lane) & 1) != 0)
+            for (auto& offset : offsets[lane])
+                offset = 0.0;
+
+    for (int i = 0; i < numSlots; ++i)
+    {
+        const auto& slot = slots[i];
+
+        if (slot.lane < base.numLanes && ((lanesToApply >> slot.lane) & 1) != 0)
+            offsets[slot.lane][slot.destination] += slot.depth * macroValues[slot.macro];
+    }
+
+    //Lanes in the mask without slots go back to their base values
+    for (int lane = 0; lane < base.numLanes; ++lane)
+    {
+        if (((lanesToApply >> lane) & 1) == 0)
+            continue;
+
+        const auto& config = base.lanes[lane];
+        const auto* offset = offsets[lane];
+
+        engine.setLaneGate(lane, modulate(config.gateLength, offset[gate], gate));
+        engine.setLaneProbability(lane, modulate(config.probability, offset[probability], probability));
+        engine.setLaneVelocity(lane, static_cast<int>(std::lround(modulate(config.velocity, offset[velocity], velocity))),
+                               modulate(config.accent, offset[accent], accent));
+        engine.setLaneMorph(lane, modulate(config.morph, offset[morph], morph));
+    }
+}
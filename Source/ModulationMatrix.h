@@ -0,0 +1,93 @@
+/*
+  ==============================================================================
+
+    ModulationMatrix.h
+
+    Assignments from the macro parameters to lane settings.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "LaneSnapshot.h"
+#include "RhythmEngine.h"
+
+//==============================================================================
+/**
+    A fixed table of slots, each moving one setting of one lane by a macro
+    scaled by its depth. Depth is a fraction of the setting's full range and
+    can be negative, slots on the same setting add up. Settings are moved in
+    the normalised space of the range the lane parameter has, so a skewed
+    parameter moves the way its knob would.
+
+    Only settings the engine can take on any block are destinations. Steps,
+    pulses and the rest of the pattern need a regenerated pattern, so they
+    stay with the lane configuration.
+
+    The matrix is filled on the message thread and handed over whole. The
+    audio thread evaluates it once per block, on top of the configuration
+    that last set the lanes.
+*/
+class ModulationMatrix
+{
+public:
+    static constexpr int numMacros = 8;
+    static constexpr int maxSlots = 64;
+
+    enum Destination
+    {
+        gate = 0,
+        probability,
+        velocity,
+        accent,
+        morph,
+        numDestinations
+    };
+
+    //A parameter's range without an interval, the same mapping to and from 0 to 1 as its NormalisableRange
+    struct Range
+    {
+        double start = 0.0;
+        double end = 1.0;
+        double skew = 1.0;
+
+        double convertTo0to1(double value) const noexcept;
+        double convertFrom0to1(double proportion) const noexcept;
+    };
+
+    struct Slot
+    {
+        int macro = 0;
+        int lane = 0;
+        Destination destination = gate;
+        double depth = 0.0;
+    };
+
+    void clear() noexcept;
+
+    //Message thread, every destination's range has to be set on each fill, it isn't cleared
+    void setRange(Destination destination, Range range) noexcept { ranges[destination] = range; }
+
+    //Returns false if the slot points nowhere or the matrix is full
+    bool addSlot(Slot slot) noexcept;
+
+    int getNumSlots() const noexcept { return numSlots; }
+    const Slot& getSlot(int index) const noexcept { return slots[index]; }
+
+    //Lanes with at least one slot
+    uint64_t getLanes() const noexcept { return lanes; }
+
+    //Sets the destinations of every lane in the mask from the base configuration plus its slots
+    void apply(const float* macroValues, const LaneSnapshot& base, uint64_t lanesToApply, RhythmEngine& engine) const noexcept;
+
+private:
+    double modulate(double value, double offset, Destination destination) const noexcept;
+
+    Range ranges[numDestinations];
+    Slot slots[maxSlots];
+    int numSlots = 0;
+    uint64_t lanes = 0;
+};
@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    NoteReleaseQueue.h
+
+    Pending note offs, ordered by the sample they are due at.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/**
+    Fixed capacity min-heap of note releases keyed on absolute sample time.
+    A lane holds at most one note, so the queue never needs more than one
+    entry per lane and never allocates.
+*/
+template <int capacity>
+class NoteReleaseQueue
+{
+public:
+    struct Release
+    {
+        int64_t sampleTime;
+        int lane;
+        int noteNumber;
+    };
+
+    bool isEmpty() const noexcept { return size == 0; }
+    int getNumPending() const noexcept { return size; }
+
+    //Earliest release, only valid if the queue isn't empty
+    const Release& top() const noexcept { return heap[0]; }
+
+    bool push(const Release& release) noexcept
+    {
+        if (size >= capacity)
+            return false;
+
+        heap[size] = release;
+        siftUp(size++);
+        return true;
+    }
+
+    void pop() noexcept { removeAt(0); }
+
+    //Takes the pending release of a lane out of the queue, returns false if the lane holds no note
+    bool removeLane(int lane, Release& removed) noexcept
+    {
+        for (int i = 0; i < size; ++i)
+        {
+            if (heap[i].lane == lane)
+            {
+                removed = heap[i];
+                removeAt(i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void clear() noexcept { size = 0; }
+
+private:
+    void removeAt(int index) noexcept
+    {
+        if (index >= size)
+            return;
+
+        heap[index] = heap[--size];
+
+        if (index < size)
+        {
+            siftDown(index);
+            siftUp(index);
+        }
+    }
+
+    void siftUp(int index) noexcept
+    {
+        while (index > 0)
+        {
+            auto parent = (index - 1) / 2;
+
+            if (heap[parent].sampleTime <= heap[index].sampleTime)
+                break;
+
+            swap(parent, index);
+            index = parent;
+        }
+    }
+
+    void siftDown(int index) noexcept
+    {
+        for (;;)
+        {
+            auto smallest = index;
+            auto left = 2 * index + 1;
+            auto right = left + 1;
+
+            if (left < size && heap[left].sampleTime < heap[smallest].sampleTime)
+                smallest = left;
+
+            if (right < size && heap[right].sampleTime < heap[smallest].sampleTime)
+                smallest = right;
+
+            if (smallest == index)
+                break;
+
+            swap(smallest, index);
+            index = smallest;
+        }
+    }
+
+    void swap(int a, int b) noexcept
+    {
+        auto temp = heap[a];
+        heap[a] = heap[b];
+        heap[b] = temp;
+    }
+
+    Release heap[capacity];
+    int size = 0;
+};
@@ -0,0 +1,103 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.cpp
+
+  ==============================================================================
+*/
+
+#include "OfflineRenderer.h"
+
+#include "SyntheticPlayHead.h"
+
+OfflineRenderer::Result OfflineRenderer::render(AudioProcessor& processor, const Settings& settings)
+{
+    jassert(settings.sampleRate > 0.0 && settings.blockSize > 0 && settings.bpm > 0.0);
+
+    SyntheticPlayHead playHead;
+    playHead.setSampleRate(settings.sampleRate);
+    playHead.setTempo(settings.bpm);
+    playHead.setTimeSignature(settings.beatsPerBar, 4);
+    playHead.setPositionInSamples(0);
+
+    auto* previousPlayHead = processor.getPlayHead();
+    auto wasNonRealtime = processor.isNonRealtime();
+
+    processor.setPlayHead(&playHead);
+    processor.setNonRealtime(true);
+    processor.setRateAndBufferSizeDetails(settings.sampleRate, settings.blockSize);
+    processor.prepareToPlay(settings.sampleRate, settings.blockSize);
+
+    auto numChannels = jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    AudioBuffer<float> buffer(numChannels, settings.blockSize);
+    MidiBuffer midiMessages;
+
+    auto samplesPerQuarterNote = playHead.getSamplesPerQuarterNote();
+    auto ticksPerSample = settings.ticksPerQuarterNote / samplesPerQuarterNote;
+    auto totalSamples = (int64) std::ceil(settings.numBars * settings.beatsPerBar * samplesPerQuarterNote);
+
+    MidiMessageSequence sequence;
+    sequence.addEvent(MidiMessage::tempoMetaEvent(roundToInt(60.0e6 / settings.bpm)), 0.0);
+    sequence.addEvent(MidiMessage::timeSignatureMetaEvent(settings.beatsPerBar, 4), 0.0);
+
+    Result result;
+
+    auto collectEvents = [&](int64 blockStart)
+    {
+        for (const auto metadata : midiMessages)
+        {
+            sequence.addEvent(metadata.getMessage(), (blockStart + metadata.samplePosition) * ticksPerSample);
+            ++result.numEvents;
+        }
+    };
+
+    auto startTicks = Time::getHighResolutionTicks();
+
+    for (int64 position = 0; position < totalSamples; position += settings.blockSize)
+    {
+        auto numSamples = (int) jmin((int64) settings.blockSize, totalSamples - position);
+
+        playHead.setPositionInSamples(position);
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        midiMessages.clear();
+
+        processor.processBlock(buffer, midiMessages);
+        collectEvents(position);
+    }
+
+    //One stopped block at the end releases any notes still held
+    playHead.setPositionInSamples(totalSamples);
+    playHead.setPlaying(false);
+    midiMessages.clear();
+    processor.processBlock(buffer, midiMessages);
+    collectEvents(totalSamples);
+
+    result.renderSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+    result.numBars = settings.numBars;
+
+    processor.releaseResources();
+    processor.setNonRealtime(wasNonRealtime);
+    processor.setPlayHead(previousPlayHead);
+
+    sequence.updateMatchedPairs();
+
+    result.midiFile.setTicksPerQuarterNote(settings.ticksPerQuarterNote);
+    result.midiFile.addTrack(sequence);
+    return result;
+}
+
+bool OfflineRenderer::renderToFile(AudioProcessor& processor, const Settings& settings, const File& file, Result* result)
+{
+    auto rendered = render(processor, settings);
+
+    file.deleteFile();
+    FileOutputStream stream(file);
+
+    if (! stream.openedOk() || ! rendered.midiFile.writeTo(stream))
+        return false;
+
+    if (result != nullptr)
+        *result = std::move(rendered);
+
+    return true;
+}
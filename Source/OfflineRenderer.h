@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.h
+
+    Renders the processor's MIDI output faster than realtime.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Runs an AudioProcessor's processBlock in a loop against a SyntheticPlayHead
+    and collects every MIDI event into a MidiFile. The processor is switched to
+    non-realtime before it is prepared, so every block brings itself up to
+    date instead of waiting for the message thread.
+
+    It must be called on the message thread with the processor not attached to
+    a running audio device.
+*/
+class OfflineRenderer
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        double bpm = 120.0;
+        int beatsPerBar = 4;
+        int numBars = 16;
+        int ticksPerQuarterNote = 960;
+    };
+
+    struct Result
+    {
+        MidiFile midiFile;
+        int numEvents = 0;
+        int numBars = 0;
+        double renderSeconds = 0.0;
+
+        double getBarsPerSecond() const noexcept { return renderSeconds > 0.0 ? numBars / renderSeconds : 0.0; }
+    };
+
+    static Result render(AudioProcessor& processor, const Settings& settings);
+
+    //Renders and writes a standard MIDI file, returns false if the file couldn't be written
+    static bool renderToFile(AudioProcessor& processor, const Settings& settings, const File& file, Result* result = nullptr);
+};
@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    PatternMorph.cpp
+
+  ==============================================================================
+*/
+
+#include "PatternMorph.h"
+
+#include <algorithm>
+
+namespace
+{
+    StepPattern resolve(const StepPattern& pattern) noexcept
+    {
+        auto resolved = StepPattern::rests(pattern.getLength());
+
+        for (int i = 0; i < pattern.getLength(); ++i)
+            resolved.setStep(i, pattern.isPulse(i));
+
+        return resolved;
+    }
+
+    //Whether the source's step nearest to the same point of the cycle as step of numSteps is a pulse
+    bool isPulseAt(const StepPattern& source, int step, int numSteps) noexcept
+    {
+        auto length = source.getLength();
+
+        if (length <= 0)
+            return false;
+
+        auto nearest = static_cast<int>((2 * static_cast<int64_t>(step) * length + numSteps) / (2 * numSteps));
+        return source.isPulse(nearest % length);
+    }
+}
+
+StepPattern morphPatterns(const StepPattern& from, const StepPattern& to, double amount) noexcept
+{
+    if (amount <= 0.0)
+        return resolve(from);
+
+    if (amount >= 1.0)
+        return resolve(to);
+
+    auto numSteps = static_cast<int>(from.getLength() + (to.getLength() - from.getLength()) * amount + 0.5);
+    auto numPulses = static_cast<int>(from.countPulses() + (to.countPulses() - from.countPulses()) * amount + 0.5);
+
+    if (numSteps <= 0)
+        return {};
+
+    numSteps = numSteps > StepPattern::maxSteps ? StepPattern::maxSteps : numSteps;
+    numPulses = numPulses > numSteps ? numSteps : numPulses;
+
+    //Euclidean steps weigh a little, so they only decide between steps the sources weigh the same
+    auto spread = StepPattern::euclidean(numPulses, numSteps);
+    double weights[StepPattern::maxSteps];
+    int order[StepPattern::maxSteps];
+
+    for (int i = 0; i < numSteps; ++i)
+    {
+        weights[i] = (isPulseAt(from, i, numSteps) ? 1.0 - amount : 0.0)
+                   + (isPulseAt(to, i, numSteps) ? amount : 0.0)
+                   + (spread.isPulse(i) ? 1.0e-3 : 0.0);
+        order[i] = i;
+    }
+
+    std::sort(order, order + numSteps, [&weights](int a, int b)
+    {
+        return weights[a] != weights[b] ? weights[a] > weights[b] : a < b;
+    });
+
+    auto result = StepPattern::rests(numSteps);
+
+    for (int i = 0; i < numPulses; ++i)
+        result.setStep(order[i], true);
+
+    return result;
+}
+
+void buildMorphLadder(const StepPattern& from, const StepPattern& to, MorphLadder& ladder) noexcept
+{
+    for (int level = 0; level < MorphLadder::numLevels; ++level)
+        ladder.levels[level] = morphPatterns(from, to, level / (double) (MorphLadder::numLevels - 1));
+
+    ladder.from = from;
+    ladder.to = to;
+    ladder.isReady = true;
+}
@@ -0,0 +1,50 @@
+/*
+  ==============================================================================
+
+    PatternMorph.h
+
+    Crossfading between two patterns by weighted onset selection.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "LaneSnapshot.h"
+#include "StepPattern.h"
+
+//==============================================================================
+/**
+    The pattern between from and to at amount 0 to 1.
+
+    Length and pulse count are interpolated, then every step of the result is
+    weighted by whether the matching step of each source is a pulse, scaled by
+    how close the amount is to that source. The heaviest steps become the
+    pulses, ties go to the Euclidean spread of the result. Rotation and
+    inversion of the sources are baked into the result.
+*/
+StepPattern morphPatterns(const StepPattern& from, const StepPattern& to, double amount) noexcept;
+
+//==============================================================================
+//Evenly spaced steps of one lane's morph, level 0 plays the lane's own pattern and the last one the target
+struct MorphLadder
+{
+    static constexpr int numLevels = 17;
+
+    StepPattern levels[numLevels];
+
+    //The lane's pattern and target the levels were built between
+    StepPattern from;
+    StepPattern to;
+
+    //False until the first ladder for this lane was built
+    bool isReady = false;
+};
+
+struct MorphLadders
+{
+    MorphLadder lanes[LaneSnapshot::maxLanes];
+};
+
+//Builds every level of the ladder between from and to on the calling thread
+void buildMorphLadder(const StepPattern& from, const StepPattern& to, MorphLadder& ladder) noexcept;
@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    PatternMorpher.cpp
+
+  ==============================================================================
+*/
+
+#include "PatternMorpher.h"
+
+void PatternMorpher::setSources(int lane, const StepPattern& from, const StepPattern& to)
+{
+    if (! isPositiveAndBelow(lane, maxLanes))
+        return;
+
+    const ScopedLock sl(lock);
+    auto& current = sources[lane];
+
+    auto bit = uint64(1) << lane;
+
+    if ((knownLanes & bit) != 0 && current.from == from && current.to == to)
+        return;
+
+    current.from = from;
+    current.to = to;
+    knownLanes |= bit;
+    pendingLanes |= bit;
+
+    //A ladder half built from the old patterns is of no use anymore
+    if (buildingLane == lane)
+        buildingLane = -1;
+}
+
+void PatternMorpher::buildPending()
+{
+    while (buildNextLevel())
+    {
+    }
+}
+
+int PatternMorpher::useTimeSlice()
+{
+    //Straight on to the next level while there is work, otherwise check back a little later
+    return buildNextLevel() ? 0 : 20;
+}
+
+bool PatternMorpher::buildNextLevel()
+{
+    const ScopedLock sl(lock);
+
+    if (buildingLane < 0)
+    {
+        if (pendingLanes == 0)
+            return false;
+
+        buildingLane = 0;
+
+        while (((pendingLanes >> buildingLane) & 1u) == 0)
+            ++buildingLane;
+
+        pendingLanes &= ~(uint64(1) << buildingLane);
+        buildingLevel = 0;
+        building = sources[buildingLane];
+    }
+
+    auto amount = buildingLevel / (double) (MorphLadder::numLevels - 1);
+    scratch.levels[buildingLevel] = morphPatterns(building.from, building.to, amount);
+
+    if (++buildingLevel < MorphLadder::numLevels)
+        return true;
+
+    scratch.from = building.from;
+    scratch.to = building.to;
+    scratch.isReady = true;
+    finished.lanes[buildingLane] = scratch;
+    buildingLane = -1;
+
+    //Publishing copies every lane, so wait until the lanes edited together are all done
+    if (pendingLanes == 0)
+    {
+        ladders.getWriteBuffer() = finished;
+        ladders.publish();
+    }
+
+    return true;
+}
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    PatternMorpher.h
+
+    Builds the morph ladders of every lane on a background thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "PatternMorph.h"
+#include "TripleBuffer.h"
+
+//==============================================================================
+/**
+    Keeps a MorphLadder for every lane, rebuilt whenever the lane's source or
+    target pattern changes.
+
+    Ladders are built one level per time slice into a scratch ladder, and only
+    replace the lane's ladder once complete, so the audio thread keeps playing
+    the previous one meanwhile. Finished ladders are published through a
+    triple buffer, the audio thread only ever picks up ready patterns.
+*/
+class PatternMorpher : public TimeSliceClient
+{
+public:
+    PatternMorpher() = default;
+
+    //Message thread, rebuilds the lane's ladder if either pattern changed
+    void setSources(int lane, const StepPattern& from, const StepPattern& to);
+
+    //Builds everything still pending on the calling thread, for offline rendering
+    void buildPending();
+
+    //Audio thread
+    TripleBuffer<MorphLadders>& getLadders() noexcept { return ladders; }
+
+    int useTimeSlice() override;
+
+private:
+    static constexpr int maxLanes = LaneSnapshot::maxLanes;
+
+    struct Sources
+    {
+        StepPattern from;
+        StepPattern to;
+    };
+
+    //Builds the next level, returns false when there was nothing to do
+    bool buildNextLevel();
+
+    CriticalSection lock;
+
+    Sources sources[maxLanes];
+    uint64 knownLanes = 0;
+    uint64 pendingLanes = 0;
+
+    //The lane being built and the level it is at, -1 when idle
+    int buildingLane = -1;
+    int buildingLevel = 0;
+    Sources building;
+    MorphLadder scratch;
+
+    MorphLadders finished;
+    TripleBuffer<MorphLadders> ladders;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternMorpher)
+};
@@ -6,14 +6,15 @@
 
 #include "PluginProcessor.h"
 
-#include <random>
+#include "RealtimeSafetyGuard.h"
 
 #include "foleys_gui_magic/General/foleys_MagicPluginEditor.h"
 
 //==============================================================================
 SandysRhythmGeneratorAudioProcessor::SandysRhythmGeneratorAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
-    : AudioProcessor(BusesProperties().withInput("Input", AudioChannelSet::mono(), true)//Need audio input to get sample size
+    //As a MIDI effect there are no audio buses, the block length still comes with the empty buffer
+    : AudioProcessor(BusesProperties()
 #if ! JucePlugin_IsMidiEffect
 #if ! JucePlugin_IsSynth
         .withInput("Input", juce::AudioChannelSet::stereo(), true)
@@ -23,28 +24,153 @@ SandysRhythmGeneratorAudioProcessor::SandysRhythmGeneratorAudioProcessor()
     ), parameters(*this, nullptr, Identifier("RhythmGeneratorPlugin"), createParameterLayout(getRhythmCount()))
 #endif
 {
+    storedParameters.numLaneFields = getParameterIDs(0).size();
+
     for (int i = 0; i < getRhythmCount(); ++i)
     {
         auto paramIDs = getParameterIDs(i);
-        jassert(paramIDs.size() == 5);
+        jassert(paramIDs.size() == 17);
 
-        auto activeParam = dynamic_cast<AudioParameterBool*>(parameters.getParameter(paramIDs[0]));
+#if RHYTHM_GENERATOR_HOST_LANE_PARAMETERS
+        for (auto& paramID : paramIDs)
+            storedParameters.laneFields.add(parameters.getParameter(paramID));
+#else
+        //Kept out of the host's parameter list, it automates the macros instead
+        for (auto& parameter : createLaneParameters(i))
+        {
+            parameter->addListener(this);
+            storedParameters.laneFields.add(internalLaneParameters.add(parameter.release()));
+        }
+#endif
+
+        auto activeParam = dynamic_cast<AudioParameterBool*>(getLaneParameter(i, 0));
         jassert(activeParam != nullptr);
 
-        auto noteParam = dynamic_cast<AudioParameterInt*>(parameters.getParameter(paramIDs[1]));
+        auto noteParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 1));
         jassert(noteParam != nullptr);
 
-        auto stepsParam = dynamic_cast<AudioParameterInt*>(parameters.getParameter(paramIDs[2]));
+        auto stepsParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 2));
         jassert(stepsParam != nullptr);
 
-        auto pulseParam = dynamic_cast<AudioParameterInt*>(parameters.getParameter(paramIDs[3]));
+        auto pulseParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 3));
         jassert(pulseParam != nullptr);
 
-        auto sphereParam = dynamic_cast<AudioParameterBool*>(parameters.getParameter(paramIDs[4]));
-        jassert(sphereParam != nullptr);
+        auto rotationParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 4));
+        jassert(rotationParam != nullptr);
+
+        auto invertParam = dynamic_cast<AudioParameterBool*>(getLaneParameter(i, 5));
+        jassert(invertParam != nullptr);
+
+        auto rateParam = dynamic_cast<AudioParameterChoice*>(getLaneParameter(i, 6));
+        jassert(rateParam != nullptr);
+
+        auto gateParam = dynamic_cast<AudioParameterFloat*>(getLaneParameter(i, 7));
+        jassert(gateParam != nullptr);
+
+        auto algorithmParam = dynamic_cast<AudioParameterChoice*>(getLaneParameter(i, 8));
+        jassert(algorithmParam != nullptr);
+
+        auto variationParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 9));
+        jassert(variationParam != nullptr);
+
+        auto probabilityParam = dynamic_cast<AudioParameterFloat*>(getLaneParameter(i, 10));
+        jassert(probabilityParam != nullptr);
+
+        auto velocityParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 11));
+        jassert(velocityParam != nullptr);
 
-        rhythms.add(new Rhythm(activeParam, noteParam, stepsParam, pulseParam, sphereParam));
+        auto accentParam = dynamic_cast<AudioParameterFloat*>(getLaneParameter(i, 12));
+        jassert(accentParam != nullptr);
+
+        auto morphStepsParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 13));
+        jassert(morphStepsParam != nullptr);
+
+        auto morphPulseParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 14));
+        jassert(morphPulseParam != nullptr);
+
+        auto morphRotationParam = dynamic_cast<AudioParameterInt*>(getLaneParameter(i, 15));
+        jassert(morphRotationParam != nullptr);
+
+        auto morphParam = dynamic_cast<AudioParameterFloat*>(getLaneParameter(i, 16));
+        jassert(morphParam != nullptr);
+
+        rhythms.add(new Rhythm(activeParam, noteParam, stepsParam, pulseParam, rotationParam, invertParam, rateParam, gateParam,
+                               algorithmParam, variationParam, probabilityParam, velocityParam, accentParam,
+                               morphStepsParam, morphPulseParam, morphRotationParam, morphParam));
+
+        //Indicators for the GUI, fed from the telemetry bus instead of host parameters
+        auto laneNode = "Rhythm" + String(i) + ":";
+        sphereValues.add(magicState.getPropertyAsValue(laneNode + "SphereOn"));
+        currentStepValues.add(magicState.getPropertyAsValue(laneNode + "CurrentStep"));
+        clampedPulsesValues.add(magicState.getPropertyAsValue(laneNode + "ClampedPulses"));
     }
+
+    droppedTelemetryValue = magicState.getPropertyAsValue("Telemetry:Dropped");
+
+    freeRun = dynamic_cast<AudioParameterBool*>(parameters.getParameter("FreeRun"));
+    jassert(freeRun != nullptr);
+
+    internalTempo = dynamic_cast<AudioParameterFloat*>(parameters.getParameter("Tempo"));
+    jassert(internalTempo != nullptr);
+
+    grooveChoice = dynamic_cast<AudioParameterChoice*>(parameters.getParameter("Groove"));
+    jassert(grooveChoice != nullptr);
+
+    swingAmount = dynamic_cast<AudioParameterFloat*>(parameters.getParameter("Swing"));
+    jassert(swingAmount != nullptr);
+
+    morphBars = dynamic_cast<AudioParameterInt*>(parameters.getParameter("MorphBars"));
+    jassert(morphBars != nullptr);
+
+    midiInputMode = dynamic_cast<AudioParameterChoice*>(parameters.getParameter("MidiInputMode"));
+    jassert(midiInputMode != nullptr);
+
+    midiRootNote = dynamic_cast<AudioParameterInt*>(parameters.getParameter("MidiRootNote"));
+    jassert(midiRootNote != nullptr);
+
+    songMode = dynamic_cast<AudioParameterBool*>(parameters.getParameter("SongMode"));
+    jassert(songMode != nullptr);
+
+    for (int i = 0; i < ModulationMatrix::numMacros; ++i)
+    {
+        macros[i] = dynamic_cast<AudioParameterFloat*>(parameters.getParameter("Macro" + String(i + 1)));
+        jassert(macros[i] != nullptr);
+    }
+
+    //Everything the host sees that isn't a lane setting is stored by name
+    for (auto* param : getParameters())
+        if (auto* ranged = dynamic_cast<RangedAudioParameter*>(param))
+            if (! storedParameters.laneFields.contains(ranged))
+                storedParameters.globals.add(ranged);
+
+    //A new instance picks its seed once, from then on it travels with the session
+    randomSeed = (uint64) Random::getSystemRandom().nextInt64();
+    parameters.state.setProperty(randomSeedID, (int64) randomSeed, nullptr);
+
+    telemetry = magicState.createAndAddObject<TelemetryBus>("telemetry");
+
+    //Builds with internal lane settings have no other way to set up their lanes from the editor
+    magicState.addTrigger("LoadPresetBank", [this] { chooseFileToLoad("Load preset bank", "*.srgbank", [this](const File& file) { return loadPresetBank(file); }); });
+    magicState.addTrigger("LoadSong", [this] { chooseFileToLoad("Load song", "*", [this](const File& file) { return loadSongFile(file); }); });
+    magicState.addTrigger("LoadModulation", [this] { chooseFileToLoad("Load modulation", "*", [this](const File& file) { return loadModulationFile(file); }); });
+    magicState.addTrigger("LoadGroove", [this] { chooseFileToLoad("Load groove", "*", [this](const File& file) { return loadGrooveFile(file); }); });
+
+    defaultGuiTree = magicState.createDefaultGUITree();
+
+    engine.setNumLanes(getRhythmCount());
+
+    for (auto* param : getParameters())
+        if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*>(param))
+            parameters.addParameterListener(withID->paramID, this);
+
+    rebuildLaneSnapshot();
+    compileModulation();
+
+    parameters.state.addListener(this);
+
+    backgroundThread.addTimeSliceClient(&morpher);
+    backgroundThread.addTimeSliceClient(&stateSerializer);
+    backgroundThread.startThread();
 	
     startTimer(20);
 }
@@ -52,6 +178,19 @@ SandysRhythmGeneratorAudioProcessor::SandysRhythmGeneratorAudioProcessor()
 SandysRhythmGeneratorAudioProcessor::~SandysRhythmGeneratorAudioProcessor()
 {
     stopTimer();
+
+    parameters.state.removeListener(this);
+
+    backgroundThread.removeTimeSliceClient(&stateSerializer);
+    backgroundThread.removeTimeSliceClient(&morpher);
+    backgroundThread.stopThread(1000);
+
+    for (auto* param : getParameters())
+        if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*>(param))
+            parameters.removeParameterListener(withID->paramID, this);
+
+    for (auto* param : internalLaneParameters)
+        param->removeListener(this);
 }
 
 AudioProcessorValueTreeState::ParameterLayout SandysRhythmGeneratorAudioProcessor::createParameterLayout(const int rhythmCount) const
@@ -59,23 +198,96 @@ AudioProcessorValueTreeState::ParameterLayout SandysRhythmGeneratorAudioProcesso
 
     AudioProcessorValueTreeState::ParameterLayout params;
 
+#if RHYTHM_GENERATOR_HOST_LANE_PARAMETERS
     for (int i = 0; i < rhythmCount; ++i)
-    {
-        auto paramIDs = getParameterIDs(i);
-        jassert(paramIDs.size() == 5);
+        for (auto& parameter : createLaneParameters(i))
+            params.add(std::move(parameter));
+#else
+    ignoreUnused(rhythmCount);
+#endif
 
-        params.add(std::make_unique<AudioParameterBool>(paramIDs[0], paramIDs[0], false));
-        params.add(std::make_unique<AudioParameterInt>(paramIDs[1], paramIDs[1], 24, 127, 36));
-        params.add(std::make_unique<AudioParameterInt>(paramIDs[2], paramIDs[2], 1, 32, 8));
-        params.add(std::make_unique<AudioParameterInt>(paramIDs[3], paramIDs[3], 1, 32, 4));
-        params.add(std::make_unique<AudioParameterBool>(paramIDs[4], paramIDs[4], false));
-    }
+    //Internal clock, used when free running or when there is no host transport
+    params.add(std::make_unique<AudioParameterBool>("FreeRun", "FreeRun", false));
+    params.add(std::make_unique<AudioParameterFloat>("Tempo", "Tempo", NormalisableRange<float>(20.0f, 300.0f, 0.01f), 120.0f));
+
+    //Groove and swing shared by all lanes
+    params.add(std::make_unique<AudioParameterChoice>("Groove", "Groove", getGrooveNames(), 0));
+    params.add(std::make_unique<AudioParameterFloat>("Swing", "Swing", NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+
+    //Bars a lane takes to morph all the way across, 0 follows the Morph parameters straight away
+    params.add(std::make_unique<AudioParameterInt>("MorphBars", "MorphBars", 0, 64, 0));
+
+    //What incoming notes do to the lanes, transposition is relative to the root note
+    params.add(std::make_unique<AudioParameterChoice>("MidiInputMode", "MidiInputMode", MidiInputControl::getModeNames(), 0));
+    params.add(std::make_unique<AudioParameterInt>("MidiRootNote", "MidiRootNote", 0, 127, 60));
+
+    //Plays the loaded song instead of the lane parameters
+    params.add(std::make_unique<AudioParameterBool>("SongMode", "SongMode", false));
+
+    //The small fixed set the host automates, the modulation matrix assigns them to lane settings
+    for (int i = 0; i < ModulationMatrix::numMacros; ++i)
+        params.add(std::make_unique<AudioParameterFloat>("Macro" + String(i + 1), "Macro" + String(i + 1), NormalisableRange<float>(0.0f, 1.0f), 0.0f));
 
     return params;
 }
+
+std::vector<std::unique_ptr<RangedAudioParameter>> SandysRhythmGeneratorAudioProcessor::createLaneParameters(const int rhythmIndex)
+{
+    auto paramIDs = getParameterIDs(rhythmIndex);
+    jassert(paramIDs.size() == 17);
+
+    std::vector<std::unique_ptr<RangedAudioParameter>> laneParameters;
+
+    laneParameters.push_back(std::make_unique<AudioParameterBool>(paramIDs[0], paramIDs[0], false));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[1], paramIDs[1], 24, 127, 36));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[2], paramIDs[2], 1, StepPattern::maxSteps, 8));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[3], paramIDs[3], 1, StepPattern::maxSteps, 4));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[4], paramIDs[4], 0, StepPattern::maxSteps - 1, 0));
+    laneParameters.push_back(std::make_unique<AudioParameterBool>(paramIDs[5], paramIDs[5], false));
+    laneParameters.push_back(std::make_unique<AudioParameterChoice>(paramIDs[6], paramIDs[6], getRateNames(), 1));
+    laneParameters.push_back(std::make_unique<AudioParameterFloat>(paramIDs[7], paramIDs[7], NormalisableRange<float>(0.05f, 1.0f), 0.5f));
+    laneParameters.push_back(std::make_unique<AudioParameterChoice>(paramIDs[8], paramIDs[8], getAlgorithmNames(), 0));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[9], paramIDs[9], 0, 127, 0));
+    laneParameters.push_back(std::make_unique<AudioParameterFloat>(paramIDs[10], paramIDs[10], NormalisableRange<float>(0.0f, 1.0f), 1.0f));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[11], paramIDs[11], 1, 127, 127));
+    laneParameters.push_back(std::make_unique<AudioParameterFloat>(paramIDs[12], paramIDs[12], NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[13], paramIDs[13], 1, StepPattern::maxSteps, 8));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[14], paramIDs[14], 1, StepPattern::maxSteps, 4));
+    laneParameters.push_back(std::make_unique<AudioParameterInt>(paramIDs[15], paramIDs[15], 0, StepPattern::maxSteps - 1, 0));
+    laneParameters.push_back(std::make_unique<AudioParameterFloat>(paramIDs[16], paramIDs[16], NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+
+    return laneParameters;
+}
+
 int SandysRhythmGeneratorAudioProcessor::getRhythmCount()
 {
-    return 4;
+    static_assert(RHYTHM_GENERATOR_NUM_RHYTHMS > 0 && RHYTHM_GENERATOR_NUM_RHYTHMS <= RhythmEngine::maxLanes,
+                  "RHYTHM_GENERATOR_NUM_RHYTHMS must be between 1 and RhythmEngine::maxLanes");
+
+    return RHYTHM_GENERATOR_NUM_RHYTHMS;
+}
+
+StringArray SandysRhythmGeneratorAudioProcessor::getAlgorithmNames()
+{
+    //In the order of RhythmAlgorithm
+    StringArray names = { "Euclidean", "Necklace", "Clapping", "Random fill" };
+    jassert(names.size() == static_cast<int>(RhythmAlgorithm::numAlgorithms));
+    return names;
+}
+
+StringArray SandysRhythmGeneratorAudioProcessor::getRateNames()
+{
+    return { "1/4", "1/8", "1/16", "1/4T", "1/8T", "1/16T", "1/4.", "1/8.", "1/16." };
+}
+
+double SandysRhythmGeneratorAudioProcessor::getRateLengthPpq(const int rateIndex)
+{
+    //Straight, triplet and dotted quarters, eighths and sixteenths, in the order of getRateNames()
+    static const double lengths[] = { 1.0, 0.5, 0.25,
+                                      2.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0,
+                                      1.5, 0.75, 0.375 };
+
+    return lengths[jlimit(0, numElementsInArray(lengths) - 1, rateIndex)];
 }
 
 
@@ -119,22 +331,296 @@ double SandysRhythmGeneratorAudioProcessor::getTailLengthSeconds() const
 
 int SandysRhythmGeneratorAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    // NB: some hosts don't cope very well if you tell them there are 0 programs,
+    // so this should be at least 1, even if you're not really implementing programs.
+    return jmax(1, presetBank.getNumPrograms());
 }
 
 int SandysRhythmGeneratorAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void SandysRhythmGeneratorAudioProcessor::setCurrentProgram(int index)
 {
+    if (! isPositiveAndBelow(index, presetBank.getNumPrograms()))
+        return;
+
+    //The audio thread picks the prebuilt snapshot up at its next block, the parameters follow on the timer
+    currentProgram = index;
+    pendingProgram = &presetBank.getSnapshot(index);
+    programToSync = index;
 }
 
 const juce::String SandysRhythmGeneratorAudioProcessor::getProgramName(int index)
 {
-    return {};
+    if (! isPositiveAndBelow(index, presetBank.getNumPrograms()))
+        return {};
+
+    return presetBank.getProgram(index).name;
+}
+
+bool SandysRhythmGeneratorAudioProcessor::loadPresetBank(const File& file)
+{
+    auto numLaneFields = getParameterIDs(0).size();
+
+    //A program change still waiting would point into the bank being replaced
+    pendingProgram = nullptr;
+    programToSync = -1;
+
+    auto loaded = presetBank.load(file, numLaneFields, [this](const PresetBank::Program& program, LaneSnapshot& snapshot)
+    {
+        buildProgramSnapshot(program, snapshot);
+    });
+
+    if (! loaded)
+        return false;
+
+    currentProgram = 0;
+
+    //The song points at the snapshots of the bank it was compiled against
+    compileSong();
+
+    //Nothing shared points into the old bank from here on, it goes once the audio thread has let go of it too
+    presetBank.stampRetired(blockEpoch.getStamp());
+
+    updateHostDisplay();
+    return true;
+}
+
+float SandysRhythmGeneratorAudioProcessor::getProgramValue(const PresetBank::Program& program, int lane, int field)
+{
+    auto numLaneFields = getParameterIDs(0).size();
+    auto* parameter = getLaneParameter(lane, field);
+
+    //Going through the parameter's own range snaps and clamps the value exactly like setting the parameter would
+    auto value = program.fields[lane * numLaneFields + field];
+    auto normalised = std::isnan(value) ? parameter->getDefaultValue() : parameter->convertTo0to1(value);
+
+    return parameter->convertFrom0to1(normalised);
+}
+
+void SandysRhythmGeneratorAudioProcessor::buildProgramSnapshot(const PresetBank::Program& program, LaneSnapshot& snapshot)
+{
+    snapshot.numLanes = getRhythmCount();
+
+    //The bank can have fewer lanes than this build, the rest stay switched off
+    auto bankLanes = program.fields.size() / getParameterIDs(0).size();
+
+    for (int i = 0; i < jmin(getRhythmCount(), bankLanes); ++i)
+    {
+        auto value = [&](int field) { return getProgramValue(program, i, field); };
+        auto& lane = snapshot.lanes[i];
+
+        auto steps = roundToInt(value(2));
+        auto pulses = roundToInt(value(3));
+
+        lane.pattern = generatePattern(static_cast<RhythmAlgorithm>(roundToInt(value(8))), { pulses, steps, roundToInt(value(9)) });
+        lane.pattern.setRotation(roundToInt(value(4)));
+        lane.pattern.setInverted(value(5) >= 0.5f);
+        lane.clampedPulses = pulses > steps ? steps : 0;
+
+        lane.enabled = value(0) >= 0.5f;
+        lane.noteNumber = roundToInt(value(1));
+        lane.stepLengthPpq = getRateLengthPpq(roundToInt(value(6)));
+        lane.gateLength = value(7);
+        lane.probability = value(10);
+        lane.velocity = roundToInt(value(11));
+        lane.accent = value(12);
+        lane.morph = value(16);
+
+        //Same as the parameters build it, the lane's algorithm and variation with the morph counts and rotation
+        lane.morphTarget = generatePattern(static_cast<RhythmAlgorithm>(roundToInt(value(8))), { roundToInt(value(14)), roundToInt(value(13)), roundToInt(value(9)) });
+        lane.morphTarget.setRotation(roundToInt(value(15)));
+        lane.morphTarget.setInverted(value(5) >= 0.5f);
+    }
+}
+
+void SandysRhythmGeneratorAudioProcessor::requestMorphLadders()
+{
+    auto* inUse = laneBase.load();
+
+    //A program or a song section morphs towards its own targets
+    if (inUse != nullptr && presetBank.contains(inUse))
+    {
+        for (int i = 0; i < inUse->numLanes; ++i)
+            morpher.setSources(i, inUse->lanes[i].pattern, inUse->lanes[i].morphTarget);
+
+        return;
+    }
+
+    const SpinLock::ScopedLockType lock(laneSnapshotWriteLock);
+
+    for (int i = 0; i < rhythms.size(); ++i)
+        morpher.setSources(i, rhythms.getUnchecked(i)->pattern, rhythms.getUnchecked(i)->morphTarget);
+}
+
+void SandysRhythmGeneratorAudioProcessor::followOfflineLadders(const LaneSnapshot& lanes)
+{
+    auto changed = ! usingOfflineLadders;
+
+    for (int i = 0; i < lanes.numLanes; ++i)
+    {
+        const auto& lane = lanes.lanes[i];
+        auto& ladder = offlineLadders->lanes[i];
+
+        if (ladder.isReady && ladder.from == lane.pattern && ladder.to == lane.morphTarget)
+            continue;
+
+        buildMorphLadder(lane.pattern, lane.morphTarget, ladder);
+        changed = true;
+    }
+
+    if (changed)
+        engine.setMorphLadders(offlineLadders.get());
+
+    usingOfflineLadders = true;
+}
+
+void SandysRhythmGeneratorAudioProcessor::syncParametersToProgram(int index)
+{
+    const auto& program = presetBank.getProgram(index);
+    auto numLaneFields = getParameterIDs(0).size();
+    auto bankLanes = program.fields.size() / numLaneFields;
+
+    for (int lane = 0; lane < jmin(getRhythmCount(), bankLanes); ++lane)
+        for (int field = 0; field < numLaneFields; ++field)
+            if (auto* parameter = getLaneParameter(lane, field))
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(getProgramValue(program, lane, field)));
+
+    //Lanes the bank doesn't have are switched off, as they are in the program's snapshot
+    for (int lane = bankLanes; lane < getRhythmCount(); ++lane)
+        rhythms.getUnchecked(lane)->activated->setValueNotifyingHost(0.0f);
+}
+
+bool SandysRhythmGeneratorAudioProcessor::loadSongFile(const File& file)
+{
+    auto text = file.loadFileAsString();
+
+    if (parseSong(text).empty())
+        return false;
+
+    parameters.state.setProperty(songID, text, nullptr);
+    compileSong();
+
+    return songTimeline.load() != nullptr;
+}
+
+std::vector<SongSection> SandysRhythmGeneratorAudioProcessor::parseSong(const String& text)
+{
+    std::vector<SongSection> sections;
+
+    for (auto line : StringArray::fromLines(text))
+    {
+        line = line.upToFirstOccurrenceOf("#", false, false).trim();
+
+        if (line.isEmpty())
+            continue;
+
+        auto tokens = StringArray::fromTokens(line, " \t,;", {});
+        tokens.removeEmptyStrings();
+
+        SongSection section;
+        section.program = tokens[0].getIntValue() - 1;
+        section.bars = tokens.size() > 1 ? tokens[1].getIntValue() : 1;
+        section.repeats = tokens.size() > 2 ? tokens[2].getIntValue() : 1;
+
+        sections.push_back(section);
+    }
+
+    return sections;
+}
+
+void SandysRhythmGeneratorAudioProcessor::compileSong()
+{
+    auto sections = parseSong(parameters.state.getProperty(songID).toString());
+
+    auto compiled = std::make_unique<SongTimeline>(sections, [this](int program) -> const LaneSnapshot*
+    {
+        return isPositiveAndBelow(program, presetBank.getNumPrograms()) ? &presetBank.getSnapshot(program) : nullptr;
+    });
+
+    if (compiled->isEmpty())
+        compiled.reset();
+
+    //The audio thread finds its place in the new timeline at its next block
+    songTimeline = compiled.get();
+
+    if (currentSong != nullptr)
+        retiredSongs.push_back({ std::move(currentSong), blockEpoch.getStamp() });
+
+    currentSong = std::move(compiled);
+}
+
+void SandysRhythmGeneratorAudioProcessor::releaseRetiredSongs()
+{
+    //The playing timeline is only read once the stamp has passed, so it already covers the last block
+    auto isReleasable = [this](const RetiredSong& retired)
+    {
+        return blockEpoch.hasPassed(retired.stamp) && playingSong.load() != retired.timeline.get();
+    };
+
+    retiredSongs.erase(std::remove_if(retiredSongs.begin(), retiredSongs.end(), isReleasable), retiredSongs.end());
+}
+
+bool SandysRhythmGeneratorAudioProcessor::loadModulationFile(const File& file)
+{
+    parameters.state.setProperty(modulationID, file.loadFileAsString(), nullptr);
+    return compileModulation() > 0;
+}
+
+StringArray SandysRhythmGeneratorAudioProcessor::getModulationDestinationNames()
+{
+    //In the order of ModulationMatrix::Destination, named like the lane parameters they move
+    StringArray names = { "Gate", "Probability", "Velocity", "Accent", "Morph" };
+    jassert(names.size() == static_cast<int>(ModulationMatrix::numDestinations));
+    return names;
+}
+
+int SandysRhythmGeneratorAudioProcessor::compileModulation()
+{
+    auto& matrix = modulation.getWriteBuffer();
+    matrix.clear();
+
+    //Every lane has the same ranges, so lane 0's parameters give every destination its range
+    auto destinationNames = getModulationDestinationNames();
+
+    for (int i = 0; i < destinationNames.size(); ++i)
+    {
+        const auto& range = getLaneParameter(0, getParameterIDs(0).indexOf(destinationNames[i] + "0"))->getNormalisableRange();
+        jassert(! range.symmetricSkew);
+
+        matrix.setRange(static_cast<ModulationMatrix::Destination>(i), { range.start, range.end, range.skew });
+    }
+
+    for (auto line : StringArray::fromLines(parameters.state.getProperty(modulationID).toString()))
+    {
+        line = line.upToFirstOccurrenceOf("#", false, false).trim();
+
+        if (line.isEmpty())
+            continue;
+
+        auto tokens = StringArray::fromTokens(line, " \t,;", {});
+        tokens.removeEmptyStrings();
+
+        auto destination = getModulationDestinationNames().indexOf(tokens[2], true);
+
+        if (destination < 0 || ! isPositiveAndBelow(tokens[1].getIntValue() - 1, getRhythmCount()))
+            continue;
+
+        ModulationMatrix::Slot slot;
+        slot.macro = tokens[0].getIntValue() - 1;
+        slot.lane = tokens[1].getIntValue() - 1;
+        slot.destination = static_cast<ModulationMatrix::Destination>(destination);
+        slot.depth = tokens[3].getDoubleValue();
+
+        matrix.addSlot(slot);
+    }
+
+    auto numSlots = matrix.getNumSlots();
+    modulation.publish();
+
+    return numSlots;
 }
 
 void SandysRhythmGeneratorAudioProcessor::changeProgramName(int index, const juce::String& newName)
@@ -146,13 +632,19 @@ void SandysRhythmGeneratorAudioProcessor::prepareToPlay(double sampleRate, int s
 {
     fs = sampleRate;
     time = 0;
-    stepIndex = -1;
+    engine.prepare(sampleRate);
+    internalClock.prepare(sampleRate);
+    blockEvents.prepare(getMaxEventsPerBlock(sampleRate, samplesPerBlock));
+
+    //Offline blocks build their own ladders, the host may switch to offline at any time after this
+    if (offlineLadders == nullptr)
+        offlineLadders = std::make_unique<MorphLadders>();
 }
 
 void SandysRhythmGeneratorAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    //Notes still held are released as soon as processing starts again
+    engine.requestReleaseAll();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -181,77 +673,257 @@ bool SandysRhythmGeneratorAudioProcessor::isBusesLayoutSupported(const BusesLayo
 
 void SandysRhythmGeneratorAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    //Counts allocations and locks from here on in builds with RHYTHM_GENERATOR_REALTIME_GUARD
+    RealtimeSafetyGuard::ScopedRealtimeSection realtimeSection(! isNonRealtime());
+    BlockEpoch::ScopedBlock epochBlock(blockEpoch);
 
+#if ! JucePlugin_IsMidiEffect
     buffer.clear();
+#endif
 
     auto numSamples = buffer.getNumSamples();
 	
-    //Get timing info from host
+    //Get timing info from host, without it the internal clock keeps time
     auto* playHead = getPlayHead();
+    auto hasHostPosition = playHead != nullptr && playHead->getCurrentPosition(posInfo);
+
+    //The list is sized for the fastest rate at the highest tempo, anything past that is dropped and counted rather than
+    //growing the host's buffer here
+    auto emitEvent = [&](const RhythmEngine::Event& event)
+    {
+        switch (event.type)
+        {
+            case RhythmEngine::Event::noteOn:
+                blockEvents.addNoteOn(event.sampleOffset, 1, event.noteNumber, (juce::uint8) event.velocity);
+                telemetry->push(TelemetryBus::Event::stepHit, event.lane, event.noteNumber);
+                telemetry->push(TelemetryBus::Event::currentStep, event.lane, event.stepIndex);
+                break;
+
+            case RhythmEngine::Event::noteOff:
+                blockEvents.addNoteOff(event.sampleOffset, 1, event.noteNumber);
+                break;
+
+            case RhythmEngine::Event::rest:
+                telemetry->push(TelemetryBus::Event::currentStep, event.lane, event.stepIndex);
+                break;
+
+            default:
+                break;
+        }
+    };
+
+    internalClock.setTempo(internalTempo->get());
 
-    if (playHead != nullptr)
+    //Always advanced, so it is already phase locked when it has to take over from the host
+    auto clockPosition = internalClock.advance(hasHostPosition ? &posInfo : nullptr, numSamples);
+    auto useInternalClock = freeRun->get() || ! hasHostPosition;
+
+    if (! useInternalClock && posInfo.isPlaying == false)
     {
-        playHead->getCurrentPosition(posInfo); 
+        //Release anything still held so stopping never leaves notes hanging
+        engine.stop(emitEvent);
+
+        //Input still has to be followed, a gate note released while stopped would stay held otherwise
+        midiInput.beginBlock(static_cast<MidiInputControl::Mode>(midiInputMode->getIndex()), midiRootNote->get(), engine);
+
+        for (const auto metadata : midiMessages)
+            midiInput.handle(metadata.data, metadata.numBytes, engine);
+
+        blockEvents.sortAndAppendTo(midiMessages, ! midiInput.consumesNotes());
+        return;
     }
 
-    auto bpm = posInfo.bpm;
-    auto bps = bpm / 60.0f;
-    auto samplesPerBeat = (fs / bps) / 2;
-    auto beatsPerBuffer = numSamples * bpm / 60.0 / fs;
-    auto counter = static_cast<int>(posInfo.timeInSamples % (int)(samplesPerBeat));
-    auto ppqPos = posInfo.ppqPosition;
-    auto eventTime = counter % numSamples;
-    
-    for (auto rhythm : rhythms)
+    //Whatever set the lanes last is what the macros modulate
+    auto setLanes = [&](const LaneSnapshot& lanes)
+    {
+        engine.applyLaneConfigs(lanes);
+        laneBase = &lanes;
+    };
+
+    //In song mode the section owns the lanes, anything else that sets them hands them back to it
+    const auto* song = songMode->get() ? songTimeline.load() : nullptr;
+
+    //An offline block plays every change made before it, the timer leaves rebuilding to us while offline so the lock is
+    //only ever busy around a switch of mode. Whatever is left then is picked up by the next block
+    auto isOffline = isNonRealtime();
+
+    if (isOffline && laneSnapshotDirty.exchange(false))
+    {
+        const SpinLock::ScopedTryLockType lock(laneSnapshotWriteLock);
+
+        if (lock.isLocked())
+            publishLaneSnapshot();
+        else
+            laneSnapshotDirty = true;
+    }
+
+    if (laneSnapshots.update())
     {
-        if (rhythm->activated->get() == true && posInfo.isPlaying == true)
+        const auto& snapshot = laneSnapshots.getReadBuffer();
+        engine.applySnapshot(snapshot);
+        laneBase = &snapshot;
+        songEntry = -1;
+
+        for (int i = 0; i < snapshot.numLanes; ++i)
+            telemetry->push(TelemetryBus::Event::pulsesClamped, i, snapshot.lanes[i].clampedPulses);
+    }
+
+    //A program change swaps all lanes at once, ahead of the parameters catching up
+    if (auto* program = pendingProgram.exchange(nullptr))
+    {
+        setLanes(*program);
+        songEntry = -1;
+    }
+
+    //Emit every step of every lane in the block at the sample it falls on, and the releases that are due
+    RhythmEngine::Transport transport;
+    transport.ppqPosition = useInternalClock ? clockPosition.ppqPosition : posInfo.ppqPosition;
+    transport.bpm = useInternalClock ? clockPosition.bpm : posInfo.bpm;
+    transport.isLooping = ! useInternalClock && posInfo.isLooping;
+    transport.loopStartPpq = posInfo.ppqLoopStart;
+    transport.loopEndPpq = posInfo.ppqLoopEnd;
+
+    auto quartersPerBar = ! useInternalClock && posInfo.timeSigDenominator > 0 ? posInfo.timeSigNumerator * 4.0 / posInfo.timeSigDenominator : 4.0;
+    transport.quartersPerBar = quartersPerBar;
+    auto barsToSectionEnd = 0.0;
+
+    //The timeline is only searched after a jump, in between the next boundary is counted down to
+    if (song != nullptr)
+    {
+        auto bar = song->wrapBar(transport.ppqPosition / quartersPerBar);
+
+        if (song != playingSong || ! song->contains(songEntry, bar))
         {
+            songEntry = song->findEntry(bar);
+            setLanes(*song->getEntry(songEntry).snapshot);
+        }
 
-            int steps = rhythm->steps->get();
-            int pulses = rhythm->pulses->get();
+        barsToSectionEnd = song->getEntryEndBar(songEntry) - bar;
+    }
+    else if (playingSong != nullptr)
+    {
+        //Leaving song mode gives the lanes back to the parameters
+        setLanes(laneSnapshots.getReadBuffer());
+        songEntry = -1;
+    }
 
-        	
-            int note = rhythm->note->get();
+    playingSong = song;
 
-            if (pulses > steps)
-            {
-                rhythm->pulses->setValueNotifyingHost(steps);
-            }
+    //Offline the ladders are built here rather than waited for, so a render doesn't depend on the background thread
+    if (isOffline)
+    {
+        if (auto* base = laneBase.load())
+            followOfflineLadders(*base);
+    }
+    else if (morpher.getLadders().update() || usingOfflineLadders)
+    {
+        engine.setMorphLadders(&morpher.getLadders().getReadBuffer());
+        usingOfflineLadders = false;
+    }
 
-            //Call Euclidean algorithm and store pulses and steps into string
-            std::string rhythmSeq = euclidean(pulses, steps);
+    //Macros are evaluated once per block, lanes only the previous matrix moved go back to their base
+    float macroValues[ModulationMatrix::numMacros];
 
-            if ((counter + numSamples) >= samplesPerBeat || posInfo.ppqPosition == 0.0)
-            //if (ppqPos == floor(ppqPos) || (ppqPos + beatsPerBuffer) >= (floor(ppqPos) + 1))
-            {
-                //Reset indexing when reaching end of rhythm 
-                if (stepIndex >= steps - 1)
-                {
-                    stepIndex = -1;
-                }
-
-                stepIndex++;
-            	
-                if (rhythmSeq[stepIndex] == '1')
-                {
-                    midiMessages.addEvent(MidiMessage::noteOn(1, note, (juce::uint8) 127), midiMessages.getLastEventTime() + 1);
-                    rhythm->sphere->setValueNotifyingHost(true);
-                }
-            	else if (rhythmSeq[stepIndex] == '0')
-                {
-                    midiMessages.addEvent(MidiMessage::noteOff(1, note, (juce::uint8) 0), midiMessages.getLastEventTime() + 1);
-                    rhythm->sphere->setValueNotifyingHost(true);
-                }
-            }
-            else
+    for (int i = 0; i < ModulationMatrix::numMacros; ++i)
+        macroValues[i] = macros[i]->get();
+
+    auto previouslyModulated = modulatedLanes;
+    modulation.update();
+    modulatedLanes = modulation.getReadBuffer().getLanes();
+
+    if (auto* base = laneBase.load())
+        modulation.getReadBuffer().apply(macroValues, *base, modulatedLanes | previouslyModulated, engine);
+
+    //The block's position and tempo are taken once, the segments it is split into carry on along the same tempo ramp
+    auto isScheduling = engine.beginBlock(transport, numSamples, emitEvent);
+    auto segmentStart = 0;
+
+    auto processSegment = [&](int segmentEnd)
+    {
+        engine.processUntil(segmentEnd, emitEvent);
+        segmentStart = segmentEnd;
+    };
+
+    //Song sections change on their own sample too
+    auto processUntil = [&](int segmentEnd)
+    {
+        while (song != nullptr && isScheduling)
+        {
+            auto boundary = std::ceil(engine.getBlockSampleOffset(barsToSectionEnd * quartersPerBar));
+
+            if (boundary >= segmentEnd)
+                break;
+
+            if (boundary > segmentStart)
+                processSegment((int) boundary);
+
+            const auto* previous = song->getEntry(songEntry).snapshot;
+            songEntry = (songEntry + 1) % song->getNumEntries();
+
+            const auto& entry = song->getEntry(songEntry);
+            barsToSectionEnd += song->getEntryEndBar(songEntry) - entry.startBar;
+
+            //The last section wrapping round to a first one that plays the same program goes on seamlessly
+            if (entry.snapshot != previous)
             {
-                rhythm->sphere->setValueNotifyingHost(false);
-            }
+                setLanes(*entry.snapshot);
 
-               
+                if (isOffline)
+                    followOfflineLadders(*entry.snapshot);
+
+                modulation.getReadBuffer().apply(macroValues, *entry.snapshot, modulatedLanes, engine);
+            }
         }
 
+        if (segmentEnd > segmentStart)
+            processSegment(segmentEnd);
+    };
+
+    //Notes that control the lanes split the block, so each one takes effect on its own sample
+    midiInput.beginBlock(static_cast<MidiInputControl::Mode>(midiInputMode->getIndex()), midiRootNote->get(), engine);
+
+    if (midiInput.consumesNotes())
+    {
+        for (const auto metadata : midiMessages)
+        {
+            if (! midiInput.isControlMessage(metadata.data, metadata.numBytes))
+                continue;
+
+            auto position = jlimit(0, numSamples, metadata.samplePosition);
+
+            if (position > segmentStart)
+                processUntil(position);
+
+            midiInput.handle(metadata.data, metadata.numBytes, engine);
+        }
     }
+
+    if (segmentStart < numSamples)
+        processUntil(numSamples);
+
+    engine.endBlock(emitEvent);
+
+    //Generated events go into the host's buffer in one sorted pass, input notes are dropped when they controlled the lanes
+    blockEvents.sortAndAppendTo(midiMessages, ! midiInput.consumesNotes());
+}
+
+int SandysRhythmGeneratorAudioProcessor::getMaxEventsPerBlock(double sampleRate, int samplesPerBlock)
+{
+    auto shortestStepPpq = getRateLengthPpq(0);
+
+    for (int i = 1; i < getRateNames().size(); ++i)
+        shortestStepPpq = jmin(shortestStepPpq, getRateLengthPpq(i));
+
+    //Every step can release the lane's previous note and start a new one, and stopping releases one per lane
+    auto shortestStepSamples = shortestStepPpq * sampleRate * 60.0 / maxTempoBpm;
+    auto maxStepsPerBlock = (int) std::ceil(samplesPerBlock / shortestStepSamples) + 1;
+
+    return getRhythmCount() * (2 * maxStepsPerBlock + 1);
+}
+
+StepScheduler::JitterReport SandysRhythmGeneratorAudioProcessor::getTimingJitter() const
+{
+    return engine.getJitterReport();
 }
 
 //==============================================================================
@@ -267,12 +939,49 @@ juce::AudioProcessorEditor* SandysRhythmGeneratorAudioProcessor::createEditor()
     return new foleys::MagicPluginEditor(magicState);
 }
 
+ValueTree SandysRhythmGeneratorAudioProcessor::MagicState::createDefaultGUITree() const
+{
+    auto root = foleys::MagicProcessorState::createDefaultGUITree();
+
+    ValueTree files { foleys::IDs::view, { { foleys::IDs::caption, "Files" }, { foleys::IDs::styleClass, "group" } } };
+
+    for (auto trigger : { std::make_pair("Preset bank", "LoadPresetBank"), std::make_pair("Song", "LoadSong"),
+                          std::make_pair("Modulation", "LoadModulation"), std::make_pair("Groove", "LoadGroove") })
+    {
+        files.appendChild({ foleys::IDs::textButton, { { "text", trigger.first }, { "onClick", trigger.second } } }, nullptr);
+    }
+
+    root.appendChild(files, nullptr);
+
+    root.appendChild({ foleys::IDs::label, { { foleys::IDs::caption, "Telemetry dropped" }, { "value", "Telemetry:Dropped" } } }, nullptr);
+    return root;
+}
+
+void SandysRhythmGeneratorAudioProcessor::chooseFileToLoad(const String& title, const String& patterns, std::function<bool(const File&)> load)
+{
+    fileChooser = std::make_unique<FileChooser>(title, File(), patterns);
+
+    fileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles, [title, load](const FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+
+        if (file.existsAsFile() && ! load(file))
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, title, "Nothing in " + file.getFileName() + " could be loaded.");
+    });
+}
+
 //==============================================================================
 void SandysRhythmGeneratorAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
     // You should use this method to store your parameters in the memory block.
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
+    if (! stateSerializer.copyLatest(destData))
+        PluginStateFormat::write(parameters, storedParameters, defaultGuiTree, destData);
+}
+
+void SandysRhythmGeneratorAudioProcessor::getValueTreeStateInformation(juce::MemoryBlock& destData)
+{
     magicState.getStateInformation(destData);
 }
 
@@ -280,24 +989,105 @@ void SandysRhythmGeneratorAudioProcessor::setStateInformation(const void* data,
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
-    magicState.setStateInformation(data, sizeInBytes, getActiveEditor());
+    if (PluginStateFormat::isBinaryState(data, sizeInBytes))
+    {
+        if (! PluginStateFormat::read(parameters, storedParameters, data, sizeInBytes))
+            return;
+
+        int width, height;
+
+        if (auto* editor = getActiveEditor())
+            if (magicState.getLastEditorSize(width, height))
+                editor->setSize(width, height);
+    }
+    else
+    {
+        //Sessions saved before the binary format
+        magicState.setStateInformation(data, sizeInBytes, getActiveEditor());
+
+#if ! RHYTHM_GENERATOR_HOST_LANE_PARAMETERS
+        //Their lane settings were host parameters, the tree still holds the values
+        for (auto* parameter : storedParameters.laneFields)
+        {
+            auto saved = parameters.state.getChildWithProperty("id", parameter->paramID);
+
+            if (saved.isValid())
+            {
+                parameter->setValueNotifyingHost(parameter->convertTo0to1((float) saved.getProperty("value")));
+                parameters.state.removeChild(saved, nullptr);
+            }
+        }
+#endif
+    }
+
+    //Sessions saved before there was a seed keep the one this instance started with
+    if (parameters.state.hasProperty(randomSeedID))
+        randomSeed = (uint64) (int64) parameters.state.getProperty(randomSeedID);
+    else
+        parameters.state.setProperty(randomSeedID, (int64) randomSeed, nullptr);
+
+    {
+        const SpinLock::ScopedLockType lock(laneSnapshotWriteLock);
+        customGroove = GrooveTemplate::fromText(parameters.state.getProperty(customGrooveID).toString());
+    }
+
+    compileSong();
+    compileModulation();
+
+    laneSnapshotDirty = true;
+    stateSerializer.markChanged();
 }
 
-SandysRhythmGeneratorAudioProcessor::Rhythm::Rhythm(AudioParameterBool* isActive, AudioParameterInt* noteNumber, AudioParameterInt* stepsNumber, AudioParameterInt* pulseNumber, AudioParameterBool* sphereOn)
+SandysRhythmGeneratorAudioProcessor::Rhythm::Rhythm(AudioParameterBool* isActive, AudioParameterInt* noteNumber, AudioParameterInt* stepsNumber, AudioParameterInt* pulseNumber,
+                                                    AudioParameterInt* rotationAmount, AudioParameterBool* isInverted, AudioParameterChoice* stepRate, AudioParameterFloat* gateLength,
+                                                    AudioParameterChoice* patternAlgorithm, AudioParameterInt* patternVariation,
+                                                    AudioParameterFloat* pulseProbability, AudioParameterInt* pulseVelocity, AudioParameterFloat* accentAmount,
+                                                    AudioParameterInt* morphStepsNumber, AudioParameterInt* morphPulseNumber, AudioParameterInt* morphRotationAmount, AudioParameterFloat* morphAmount)
     :
-    activated(isActive), note(noteNumber), steps(stepsNumber), pulses(pulseNumber), sphere(sphereOn)
+    activated(isActive), note(noteNumber), steps(stepsNumber), pulses(pulseNumber), rotation(rotationAmount), invert(isInverted), rate(stepRate), gate(gateLength),
+    algorithm(patternAlgorithm), variation(patternVariation), probability(pulseProbability), velocity(pulseVelocity), accent(accentAmount),
+    morphSteps(morphStepsNumber), morphPulses(morphPulseNumber), morphRotation(morphRotationAmount), morph(morphAmount)
 {
     
 }
 
-void SandysRhythmGeneratorAudioProcessor::Rhythm::reset()
+void SandysRhythmGeneratorAudioProcessor::Rhythm::updatePattern(int pulseCount, int stepCount)
 {
-    cachedMidiNote = note->get();
-    activated->setValueNotifyingHost(false);
-    note->setValueNotifyingHost(36);
-    steps->setValueNotifyingHost(8);
-    pulses->setValueNotifyingHost(4);
-    sphere->setValueNotifyingHost(false);
+    auto algorithmIndex = algorithm->getIndex();
+    auto variationIndex = variation->get();
+
+    if (pulseCount != cachedPulses || stepCount != cachedSteps || algorithmIndex != cachedAlgorithm || variationIndex != cachedVariation)
+    {
+        pattern = generatePattern(static_cast<RhythmAlgorithm>(algorithmIndex), { pulseCount, stepCount, variationIndex });
+        cachedPulses = pulseCount;
+        cachedSteps = stepCount;
+        cachedAlgorithm = algorithmIndex;
+        cachedVariation = variationIndex;
+    }
+
+    //Rotation and inversion are applied when a step is read, so they never regenerate the pattern
+    pattern.setRotation(rotation->get());
+    pattern.setInverted(invert->get());
+}
+
+void SandysRhythmGeneratorAudioProcessor::Rhythm::updateMorphTarget()
+{
+    auto algorithmIndex = algorithm->getIndex();
+    auto variationIndex = variation->get();
+    auto pulseCount = morphPulses->get();
+    auto stepCount = morphSteps->get();
+
+    if (pulseCount != cachedMorphPulses || stepCount != cachedMorphSteps || algorithmIndex != cachedMorphAlgorithm || variationIndex != cachedMorphVariation)
+    {
+        morphTarget = generatePattern(static_cast<RhythmAlgorithm>(algorithmIndex), { pulseCount, stepCount, variationIndex });
+        cachedMorphPulses = pulseCount;
+        cachedMorphSteps = stepCount;
+        cachedMorphAlgorithm = algorithmIndex;
+        cachedMorphVariation = variationIndex;
+    }
+
+    morphTarget.setRotation(morphRotation->get());
+    morphTarget.setInverted(invert->get());
 }
 
 StringArray SandysRhythmGeneratorAudioProcessor::getParameterIDs(const int rhythmIndex)
@@ -306,9 +1096,22 @@ StringArray SandysRhythmGeneratorAudioProcessor::getParameterIDs(const int rhyth
     String note = "NoteNumber";
     String steps = "Steps";
     String pulses = "Pulses";
-    String sphere = "SphereOn";
+    String rotation = "Rotation";
+    String invert = "Invert";
+    String rate = "Rate";
+    String gate = "Gate";
+    String algorithm = "Algorithm";
+    String variation = "Variation";
+    String probability = "Probability";
+    String velocity = "Velocity";
+    String accent = "Accent";
+    String morphSteps = "MorphSteps";
+    String morphPulses = "MorphPulses";
+    String morphRotation = "MorphRotation";
+    String morph = "Morph";
 
-    StringArray paramIDs = { activated, note, steps, pulses, sphere};
+    StringArray paramIDs = { activated, note, steps, pulses, rotation, invert, rate, gate, algorithm, variation, probability, velocity, accent,
+                             morphSteps, morphPulses, morphRotation, morph };
 
     //Append Rhythms index to parameter IDs
     for (int i = 0; i < paramIDs.size(); ++i)
@@ -316,14 +1119,196 @@ StringArray SandysRhythmGeneratorAudioProcessor::getParameterIDs(const int rhyth
     return paramIDs;
 }
 
+RangedAudioParameter* SandysRhythmGeneratorAudioProcessor::getLaneParameter(int rhythmIndex, int field) const
+{
+    jassert(isPositiveAndBelow(field, storedParameters.numLaneFields));
+    return storedParameters.laneFields[rhythmIndex * storedParameters.numLaneFields + field];
+}
+
+StringArray SandysRhythmGeneratorAudioProcessor::getGrooveNames()
+{
+    auto names = GrooveTemplate::getPresetNames();
+    names.add("Custom");
+    return names;
+}
+
+bool SandysRhythmGeneratorAudioProcessor::loadGrooveFile(const File& file)
+{
+    auto text = file.loadFileAsString();
+    auto groove = GrooveTemplate::fromText(text);
+
+    if (groove.isEmpty())
+        return false;
+
+    {
+        const SpinLock::ScopedLockType lock(laneSnapshotWriteLock);
+        customGroove = groove;
+    }
+
+    parameters.state.setProperty(customGrooveID, groove.toText(), nullptr);
+
+    auto customIndex = grooveChoice->choices.size() - 1;
+    grooveChoice->setValueNotifyingHost(grooveChoice->convertTo0to1((float) customIndex));
+
+    laneSnapshotDirty = true;
+    return true;
+}
+
 void SandysRhythmGeneratorAudioProcessor::timerCallback()
 {
-	
-    for (auto rhythm : rhythms)
+    //Parameters follow a program change first, so the rebuild below already has them
+    auto programIndex = programToSync.exchange(-1);
+
+    if (programIndex >= 0)
+        syncParametersToProgram(programIndex);
+
+    if (! isNonRealtime() && laneSnapshotDirty.exchange(false))
+        rebuildLaneSnapshot();
+
+    requestMorphLadders();
+    presetBank.releaseRetired(blockEpoch, laneBase);
+    releaseRetiredSongs();
+
+    captureStateIfSettled();
+    drainTelemetry();
+}
+
+void SandysRhythmGeneratorAudioProcessor::captureStateIfSettled()
+{
+    //Waits for a tick without changes, so continuous automation doesn't capture on every tick
+    auto change = stateSerializer.getChangeCount();
+    auto hasSettled = change == lastSeenStateChange;
+    lastSeenStateChange = change;
+
+    if (! hasSettled || change == lastCapturedStateChange)
+        return;
+
+    auto snapshot = std::make_unique<PluginStateFormat::Snapshot>(PluginStateFormat::capture(parameters, storedParameters, defaultGuiTree));
+    stateSerializer.submit(std::move(snapshot), change);
+    lastCapturedStateChange = change;
+}
+
+bool SandysRhythmGeneratorAudioProcessor::isTelemetryTree(const ValueTree& tree) const
+{
+    auto telemetryRoot = parameters.state.getChildWithName(telemetryRootID);
+    return telemetryRoot.isValid() && (tree == telemetryRoot || tree.isAChildOf(telemetryRoot));
+}
+
+void SandysRhythmGeneratorAudioProcessor::valueTreePropertyChanged(ValueTree& tree, const Identifier&)
+{
+    if (! isTelemetryTree(tree))
+        stateSerializer.markChanged();
+}
+
+void SandysRhythmGeneratorAudioProcessor::valueTreeChildAdded(ValueTree&, ValueTree& child)
+{
+    if (! isTelemetryTree(child))
+        stateSerializer.markChanged();
+}
+
+void SandysRhythmGeneratorAudioProcessor::valueTreeChildRemoved(ValueTree& parent, ValueTree& child, int)
+{
+    //The removed child is already detached, so it is recognised by its parent or its type
+    if (! isTelemetryTree(parent) && child.getType() != telemetryRootID)
+        stateSerializer.markChanged();
+}
+
+void SandysRhythmGeneratorAudioProcessor::valueTreeRedirected(ValueTree&)
+{
+    stateSerializer.markChanged();
+}
+
+void SandysRhythmGeneratorAudioProcessor::drainTelemetry()
+{
+    uint64 hitLanes = 0;
+
+    telemetry->drain([&](const TelemetryBus::Event& event)
     {
-        if (rhythm->activated->get() != true)
+        if (! isPositiveAndBelow(event.lane, rhythms.size()))
             return;
+
+        switch (event.type)
+        {
+            case TelemetryBus::Event::stepHit:          hitLanes |= uint64(1) << event.lane; break;
+            case TelemetryBus::Event::currentStep:      currentStepValues.getReference(event.lane) = event.value; break;
+            case TelemetryBus::Event::pulsesClamped:    clampedPulsesValues.getReference(event.lane) = event.value; break;
+            default:                                    break;
+        }
+    });
+
+    //A sphere is lit for one frame after each hit
+    for (int i = 0; i < sphereValues.size(); ++i)
+        sphereValues.getReference(i) = ((hitLanes >> i) & 1u) != 0;
+
+    droppedTelemetryValue = telemetry->getNumDropped();
+}
+
+void SandysRhythmGeneratorAudioProcessor::parameterChanged(const String& parameterID, float)
+{
+    //Can be called from any thread, the rebuild and the state capture happen on the timer
+    //Macros are read by the audio thread every block, so they never need a rebuild
+    if (! parameterID.startsWith("Macro"))
+        laneSnapshotDirty = true;
+
+    stateSerializer.markChanged();
+}
+
+void SandysRhythmGeneratorAudioProcessor::parameterValueChanged(int, float newValue)
+{
+    parameterChanged({}, newValue);
+}
+
+void SandysRhythmGeneratorAudioProcessor::rebuildLaneSnapshot()
+{
+    //The timer and an offline processBlock may both rebuild, the triple buffer only allows one writer
+    const SpinLock::ScopedLockType lock(laneSnapshotWriteLock);
+    publishLaneSnapshot();
+}
+
+void SandysRhythmGeneratorAudioProcessor::publishLaneSnapshot()
+{
+    auto& snapshot = laneSnapshots.getWriteBuffer();
+    snapshot.numLanes = rhythms.size();
+
+    for (int i = 0; i < rhythms.size(); ++i)
+    {
+        auto rhythm = rhythms.getUnchecked(i);
+        auto& lane = snapshot.lanes[i];
+
+        int steps = rhythm->steps->get();
+        int pulses = rhythm->pulses->get();
+
+        rhythm->updatePattern(pulses, steps);
+
+        //We can only have as many pulses as steps, the GUI is told through the telemetry bus
+        lane.clampedPulses = pulses > steps ? steps : 0;
+
+        lane.enabled = rhythm->activated->get();
+        lane.noteNumber = rhythm->note->get();
+        lane.stepLengthPpq = getRateLengthPpq(rhythm->rate->getIndex());
+        lane.gateLength = rhythm->gate->get();
+        lane.pattern = rhythm->pattern;
+        lane.probability = rhythm->probability->get();
+        lane.velocity = rhythm->velocity->get();
+        lane.accent = rhythm->accent->get();
+
+        //The ladder between the two is requested once the lanes play from this snapshot
+        rhythm->updateMorphTarget();
+        lane.morphTarget = rhythm->morphTarget;
+        lane.morph = rhythm->morph->get();
     }
+
+    snapshot.randomSeed = randomSeed;
+
+    //The last choice is the custom template
+    auto grooveIndex = grooveChoice->getIndex();
+    auto groove = grooveIndex < GrooveTemplate::getPresetNames().size() ? GrooveTemplate::getPreset(grooveIndex) : customGroove;
+    snapshot.groove = groove.compile(swingAmount->get());
+
+    //Turned into quarter notes by the engine, with the time signature of the block
+    snapshot.morphLengthBars = morphBars->get();
+
+    laneSnapshots.publish();
 }
 
 //==============================================================================
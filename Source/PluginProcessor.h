@@ -12,10 +12,42 @@
 
 #include "foleys_gui_magic/General/foleys_MagicProcessorState.h"
 
+#include "BlockEpoch.h"
+#include "BlockEventList.h"
+#include "GrooveTemplate.h"
+#include "InternalClock.h"
+#include "MidiInputControl.h"
+#include "ModulationMatrix.h"
+#include "PatternMorpher.h"
+#include "PluginStateFormat.h"
+#include "PresetBank.h"
+#include "RhythmAlgorithms.h"
+#include "RhythmEngine.h"
+#include "SongTimeline.h"
+#include "StateSerializer.h"
+#include "TelemetryBus.h"
+#include "TripleBuffer.h"
+
+//Number of rhythm lanes, can be raised up to RhythmEngine::maxLanes in the project's preprocessor definitions
+#ifndef RHYTHM_GENERATOR_NUM_RHYTHMS
+ #define RHYTHM_GENERATOR_NUM_RHYTHMS 4
+#endif
+
+//Whether lane settings are host parameters, builds with more lanes than hosts handle well keep them internal behind the macros.
+//The generated editor only lays out host parameters, so without them it has no lane controls, lanes are set through the files the editor loads and the macros
+#ifndef RHYTHM_GENERATOR_HOST_LANE_PARAMETERS
+ #if RHYTHM_GENERATOR_NUM_RHYTHMS <= 8
+  #define RHYTHM_GENERATOR_HOST_LANE_PARAMETERS 1
+ #else
+  #define RHYTHM_GENERATOR_HOST_LANE_PARAMETERS 0
+ #endif
+#endif
+
 //==============================================================================
 /**
 */
-class SandysRhythmGeneratorAudioProcessor : public juce::AudioProcessor, Timer
+class SandysRhythmGeneratorAudioProcessor : public juce::AudioProcessor, Timer, AudioProcessorValueTreeState::Listener, AudioProcessorParameter::Listener,
+                                            ValueTree::Listener
 {
 public:
     //==============================================================================
@@ -55,99 +87,267 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+    //The ValueTree format sessions were saved in before PluginStateFormat, setStateInformation still reads it
+    void getValueTreeStateInformation(juce::MemoryBlock& destData);
+
+    //==============================================================================
+    //How far emitted steps were from their exact boundary, in samples
+    StepScheduler::JitterReport getTimingJitter() const;
+
+    //Note ons and offs that didn't fit the block's event list since the last prepareToPlay()
+    int getNumDroppedEvents() const noexcept { return blockEvents.getNumDropped(); }
+
+    static int getRhythmCount();
+    static StringArray getParameterIDs(int rhythmIndex);
+
+    //A lane setting, in the order of getParameterIDs(), whether or not the host sees it
+    RangedAudioParameter* getLaneParameter(int rhythmIndex, int field) const;
+
+    //Reads a groove template and selects it as the custom groove, returns false if the file has no steps
+    bool loadGrooveFile(const File& file);
+
+    //Replaces the programs with the bank in the file, every program is built into a lane snapshot up front
+    bool loadPresetBank(const File& file);
+
+    //Reads a song, one "program bars repeats" line per section with programs counted from 1, returns false if nothing in it plays
+    bool loadSongFile(const File& file);
+
+    //Reads the macro assignments, one "macro lane destination depth" line per slot with macros and lanes counted from 1
+    bool loadModulationFile(const File& file);
+
 private:
 			
     AudioProcessorValueTreeState parameters;
 
     struct Rhythm
     {
-        Rhythm(AudioParameterBool* isActive, AudioParameterInt* noteNumber, AudioParameterInt* stepsNumber, AudioParameterInt* pulseNumber, AudioParameterBool* sphereOn);
+        Rhythm(AudioParameterBool* isActive, AudioParameterInt* noteNumber, AudioParameterInt* stepsNumber, AudioParameterInt* pulseNumber,
+               AudioParameterInt* rotationAmount, AudioParameterBool* isInverted, AudioParameterChoice* stepRate, AudioParameterFloat* gateLength,
+               AudioParameterChoice* patternAlgorithm, AudioParameterInt* patternVariation,
+               AudioParameterFloat* pulseProbability, AudioParameterInt* pulseVelocity, AudioParameterFloat* accentAmount,
+               AudioParameterInt* morphStepsNumber, AudioParameterInt* morphPulseNumber, AudioParameterInt* morphRotationAmount, AudioParameterFloat* morphAmount);
 
-        void reset();
+        //Regenerates the pattern only when pulses, steps, algorithm or variation changed
+        void updatePattern(int pulseCount, int stepCount);
+
+        //Same for the pattern the lane morphs towards, built with the lane's algorithm and variation
+        void updateMorphTarget();
 
         AudioParameterBool* activated;
         AudioParameterInt* note;
         AudioParameterInt* steps;
         AudioParameterInt* pulses;
-        AudioParameterBool* sphere;
-
-        int cachedMidiNote;
+        AudioParameterInt* rotation;
+        AudioParameterBool* invert;
+        AudioParameterChoice* rate;
+        AudioParameterFloat* gate;
+        AudioParameterChoice* algorithm;
+        AudioParameterInt* variation;
+        AudioParameterFloat* probability;
+        AudioParameterInt* velocity;
+        AudioParameterFloat* accent;
+        AudioParameterInt* morphSteps;
+        AudioParameterInt* morphPulses;
+        AudioParameterInt* morphRotation;
+        AudioParameterFloat* morph;
+
+        StepPattern pattern;
+        int cachedPulses = -1;
+        int cachedSteps = -1;
+        int cachedAlgorithm = -1;
+        int cachedVariation = -1;
+
+        StepPattern morphTarget;
+        int cachedMorphPulses = -1;
+        int cachedMorphSteps = -1;
+        int cachedMorphAlgorithm = -1;
+        int cachedMorphVariation = -1;
 
     };
 
     OwnedArray<Rhythm> rhythms;
 
-    static StringArray getParameterIDs(int rhythmIndex);
-
-	//Euclidean algorithm
-    std::string euclidean(int pulses, int steps)
-    {
-        //We can only have as many beats as we have steps (0 <= beats <= steps)
-        if (pulses > steps)
-            pulses = steps;
-
-        //Each iteration is a process of pairing strings X and Y and the remainder from the pairings
-        //X will hold the "dominant" pair (the pair that there are more of)
-        std::string x = "1";
-        int x_amount = pulses;
-
-        std::string y = "0";
-        int y_amount = steps - pulses;
-
-        do
-        {
-            //Placeholder variables
-            int x_temp = x_amount;
-            int y_temp = y_amount;
-            std::string y_copy = y;
-
-            //Check which is the dominant pair 
-            if (x_temp >= y_temp)
-            {
-                //Set the new number of pairs for X and Y
-                x_amount = y_temp;
-                y_amount = x_temp - y_temp;
-
-                //The previous dominant pair becomes the new non dominant pair
-                y = x;
-            }
-            else
-            {
-                x_amount = x_temp;
-                y_amount = y_temp - x_temp;
-            }
-
-            //Create the new dominant pair by combining the previous pairs
-            x = x + y_copy;
-        } while (x_amount > 1 && y_amount > 1);//iterate as long as the non dominant pair can be paired (if there is 1 Y left, all we can do is pair it with however many Xs are left, so we're done)
-
-                                               //By this point, we have strings X and Y formed through a series of pairings of the initial strings "1" and "0"
-                                               //X is the final dominant pair and Y is the second to last dominant pair
-        std::string rhythm;
-        for (int i = 1; i <= x_amount; i++)
-            rhythm += x;
-        for (int i = 1; i <= y_amount; i++)
-            rhythm += y;
-        return rhythm;
-    }
-
     double fs;
     int time;
-    int stepIndex;
+
+    //Lane state and timing, the audio thread only touches this and the published snapshots
+    RhythmEngine engine;
+
+    //Lane configurations built on the message thread whenever a parameter changes
+    TripleBuffer<LaneSnapshot> laneSnapshots;
+    std::atomic<bool> laneSnapshotDirty { true };
+    SpinLock laneSnapshotWriteLock;
+
+    void parameterChanged(const String& parameterID, float newValue) override;
+
+    //Lane settings kept internal report here instead
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int, bool) override {}
+
+    //Every lane setting and every global a session stores, the lane settings are owned here when the host doesn't see them
+    PluginStateFormat::StoredParameters storedParameters;
+    OwnedArray<RangedAudioParameter> internalLaneParameters;
+
+    static std::vector<std::unique_ptr<RangedAudioParameter>> createLaneParameters(int rhythmIndex);
+
+    //Builds a snapshot from the current parameter values and publishes it to the audio thread
+    void rebuildLaneSnapshot();
+
+    //The same without taking the lock, for a caller already holding it
+    void publishLaneSnapshot();
 
     bool noteIsOn;
 	
     int timerPeriodMs;
 
     void timerCallback() override;
+
+    //Step hits and positions from the audio thread, drained into the GUI properties on the timer
+    TelemetryBus* telemetry = nullptr;
+    Array<Value> sphereValues;
+    Array<Value> currentStepValues;
+    Array<Value> clampedPulsesValues;
+
+    //Events the GUI fell too far behind to receive, shown so a stalled display isn't mistaken for silent lanes
+    Value droppedTelemetryValue;
+
+    void drainTelemetry();
 	
     AudioProcessorValueTreeState::ParameterLayout createParameterLayout(int rhythmCount) const;
 
-    static int getRhythmCount();
+    static StringArray getAlgorithmNames();
+    static StringArray getRateNames();
+    static double getRateLengthPpq(int rateIndex);
+
+    //Note ons and offs of the current block, sized for the fastest rate at maxTempoBpm
+    BlockEventList blockEvents;
+    static constexpr double maxTempoBpm = 999.0;
+
+    static int getMaxEventsPerBlock(double sampleRate, int samplesPerBlock);
 
     AudioPlayHead::CurrentPositionInfo posInfo;
 
-    foleys::MagicProcessorState magicState{ *this, parameters };
+    //Seeds every lane's random generator, stored in the state tree so renders of a session repeat exactly
+    uint64 randomSeed = 0;
+    const Identifier randomSeedID { "RandomSeed" };
+
+    //Keeps time when free running or when the host gives no position
+    InternalClock internalClock;
+    AudioParameterBool* freeRun = nullptr;
+    AudioParameterFloat* internalTempo = nullptr;
+
+    //Groove shared by all lanes, the custom template is kept in the state tree as text
+    AudioParameterChoice* grooveChoice = nullptr;
+    AudioParameterFloat* swingAmount = nullptr;
+    GrooveTemplate customGroove;
+    const Identifier customGrooveID { "CustomGroove" };
+
+    static StringArray getGrooveNames();
+
+    //Morph ladders are built off the message thread, the audio thread picks up finished ones
+    PatternMorpher morpher;
+    AudioParameterInt* morphBars = nullptr;
+
+    //Programs switch by handing a prebuilt snapshot to the audio thread
+    PresetBank presetBank;
+    std::atomic<const LaneSnapshot*> pendingProgram { nullptr };
+    std::atomic<int> currentProgram { 0 };
+    std::atomic<int> programToSync { -1 };
+
+    //Replaced banks and songs are freed on the timer once the audio thread has moved past them
+    BlockEpoch blockEpoch;
+
+    float getProgramValue(const PresetBank::Program& program, int lane, int field);
+    void buildProgramSnapshot(const PresetBank::Program& program, LaneSnapshot& snapshot);
+
+    //Asks for the ladders between the patterns and targets of the snapshot the lanes were last set from, rebuilt only when they changed
+    void requestMorphLadders();
+
+    //Audio thread while offline, the ladders for the lanes are built on the spot when their patterns changed
+    std::unique_ptr<MorphLadders> offlineLadders;
+    bool usingOfflineLadders = false;
+
+    void followOfflineLadders(const LaneSnapshot& lanes);
+    void syncParametersToProgram(int index);
+
+    //Song mode chains programs at bar boundaries, the arrangement is compiled into a timeline on the message thread
+    AudioParameterBool* songMode = nullptr;
+    std::atomic<const SongTimeline*> songTimeline { nullptr };
+    const Identifier songID { "Song" };
+
+    std::unique_ptr<SongTimeline> currentSong;
+
+    //Timelines that were replaced, freed on the timer once the audio thread has moved past them
+    struct RetiredSong
+    {
+        std::unique_ptr<SongTimeline> timeline;
+        uint32 stamp;
+    };
+
+    std::vector<RetiredSong> retiredSongs;
+
+    //Audio thread, the timeline and entry the lanes were last set from. The timeline is only ever compared,
+    //it is kept alive all the same so a new timeline at the same address isn't taken for it
+    std::atomic<const SongTimeline*> playingSong { nullptr };
+    int songEntry = -1;
+
+    static std::vector<SongSection> parseSong(const String& text);
+    void compileSong();
+    void releaseRetiredSongs();
+
+    //Macros move lane settings through the matrix, evaluated once per block on top of whatever set the lanes last
+    AudioParameterFloat* macros[ModulationMatrix::numMacros] = {};
+    TripleBuffer<ModulationMatrix> modulation;
+    const Identifier modulationID { "Modulation" };
+
+    //Written by the audio thread, read on the timer to tell which retired snapshots are still in use
+    std::atomic<const LaneSnapshot*> laneBase { nullptr };
+    uint64 modulatedLanes = 0;
+
+    static StringArray getModulationDestinationNames();
+
+    //Returns the number of slots published
+    int compileModulation();
+
+    //Incoming notes transposing, retriggering or gating the lanes
+    MidiInputControl midiInput;
+    AudioParameterChoice* midiInputMode = nullptr;
+    AudioParameterInt* midiRootNote = nullptr;
+
+    //The generated layout, with a button for each of the files above and the dropped telemetry count added at the end
+    struct MagicState : public foleys::MagicProcessorState
+    {
+        using foleys::MagicProcessorState::MagicProcessorState;
+        ValueTree createDefaultGUITree() const override;
+    };
+
+    MagicState magicState{ *this, parameters };
+
+    //Message thread, the chooser is kept while it is open
+    std::unique_ptr<FileChooser> fileChooser;
+
+    void chooseFileToLoad(const String& title, const String& patterns, std::function<bool(const File&)> load);
+
+    //Building the default layout walks every parameter, so it's done once for every state capture to compare with
+    ValueTree defaultGuiTree;
+
+    //Session data is written in the background after every change, saving only copies it
+    StateSerializer stateSerializer;
+    uint32 lastSeenStateChange = 0;
+    uint32 lastCapturedStateChange = 0;
+
+    void captureStateIfSettled();
+
+    //Changes to the state tree outside the GUI telemetry properties
+    void valueTreePropertyChanged(ValueTree& tree, const Identifier& property) override;
+    void valueTreeChildAdded(ValueTree& parent, ValueTree& child) override;
+    void valueTreeChildRemoved(ValueTree& parent, ValueTree& child, int index) override;
+    void valueTreeRedirected(ValueTree& tree) override;
+    bool isTelemetryTree(const ValueTree& tree) const;
+    const Identifier telemetryRootID { "properties" };
+
+    //Runs the morph ladders and the state serialiser
+    TimeSliceThread backgroundThread { "Rhythm generator background" };
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SandysRhythmGeneratorAudioProcessor)
@@ -0,0 +1,371 @@
+/*
+  ==============================================================================
+
+    PluginStateFormat.cpp
+
+  ==============================================================================
+*/
+
+#include "PluginStateFormat.h"
+
+namespace
+{
+    //"SRGS" read as a little endian int
+    const int magicNumber = 0x53475253;
+
+    const Identifier guiID { "magic" };
+    const Identifier guiViewID { "View" };
+    const Identifier editorSizeID { "last-size" };
+    const Identifier widthID { "width" };
+    const Identifier heightID { "height" };
+
+    bool isFloatParameter(const RangedAudioParameter& parameter)
+    {
+        return dynamic_cast<const AudioParameterFloat*>(&parameter) != nullptr;
+    }
+}
+
+int PluginStateFormat::getFieldSize(const RangedAudioParameter& parameter, int version) noexcept
+{
+    if (isFloatParameter(parameter))
+        return version >= 2 ? 4 : 2;
+
+    auto& range = parameter.getNormalisableRange();
+    return range.end - range.start <= 255.0f ? 1 : 2;
+}
+
+bool PluginStateFormat::isBinaryState(const void* data, int sizeInBytes) noexcept
+{
+    return data != nullptr && sizeInBytes >= 4 && (int) ByteOrder::littleEndianInt(data) == magicNumber;
+}
+
+PluginStateFormat::Snapshot PluginStateFormat::capture(AudioProcessorValueTreeState& parameters, const StoredParameters& stored,
+                                                       const ValueTree& defaultGui)
+{
+    auto numLaneFields = stored.numLaneFields;
+    auto numLanes = stored.laneFields.size() / numLaneFields;
+
+    Snapshot snapshot;
+    snapshot.numLanes = numLanes;
+    snapshot.numLaneFields = numLaneFields;
+    snapshot.laneFields.ensureStorageAllocated(numLanes * numLaneFields);
+
+    for (int index = 0; index < numLanes * numLaneFields; ++index)
+    {
+        auto* parameter = stored.laneFields.getUnchecked(index);
+
+        if (isFloatParameter(*parameter))
+            snapshot.laneFields.add(parameter->getValue());
+        else
+            snapshot.laneFields.add((float) roundToInt(parameter->convertFrom0to1(parameter->getValue()) - parameter->getNormalisableRange().start));
+
+        if (index < numLaneFields)
+            snapshot.laneFieldSizes.add((uint8) getFieldSize(*parameter, currentVersion));
+    }
+
+    for (auto* parameter : stored.globals)
+    {
+        snapshot.globalIDs.add(parameter->paramID);
+        snapshot.globalValues.add(parameter->getValue());
+    }
+
+    const auto& state = parameters.state;
+
+    for (int i = 0; i < state.getNumProperties(); ++i)
+    {
+        auto name = state.getPropertyName(i);
+        snapshot.properties.set(name, state.getProperty(name));
+    }
+
+    auto editorSize = state.getChildWithName(editorSizeID);
+    snapshot.hasEditorSize = editorSize.hasProperty(widthID) && editorSize.hasProperty(heightID);
+
+    if (snapshot.hasEditorSize)
+    {
+        snapshot.editorWidth = editorSize.getProperty(widthID);
+        snapshot.editorHeight = editorSize.getProperty(heightID);
+    }
+
+    auto gui = state.getChildWithName(guiID);
+
+    if (gui.isValid() && ! gui.getChildWithName(guiViewID).isEquivalentTo(defaultGui))
+        snapshot.editedGui = gui.createCopy();
+
+    return snapshot;
+}
+
+void PluginStateFormat::write(const Snapshot& snapshot, MemoryBlock& destData)
+{
+    MemoryOutputStream stream(destData, false);
+
+    stream.writeInt(magicNumber);
+    stream.writeShort((short) currentVersion);
+    stream.writeShort((short) snapshot.numLanes);
+    stream.writeByte((char) snapshot.numLaneFields);
+
+    //Every lane has the same layout
+    int recordSize = 0;
+
+    for (auto size : snapshot.laneFieldSizes)
+    {
+        stream.writeByte((char) size);
+        recordSize += size;
+    }
+
+    stream.writeShort((short) recordSize);
+
+    for (int index = 0; index < snapshot.laneFields.size(); ++index)
+    {
+        auto value = snapshot.laneFields.getUnchecked(index);
+
+        switch (snapshot.laneFieldSizes[index % snapshot.numLaneFields])
+        {
+            case 1:     stream.writeByte((char) roundToInt(value)); break;
+            case 2:     stream.writeShort((short) roundToInt(value)); break;
+            default:    stream.writeFloat(value); break;
+        }
+    }
+
+    stream.writeShort((short) snapshot.globalIDs.size());
+
+    for (int i = 0; i < snapshot.globalIDs.size(); ++i)
+    {
+        stream.writeString(snapshot.globalIDs[i]);
+        stream.writeFloat(snapshot.globalValues[i]);
+    }
+
+    stream.writeShort((short) snapshot.properties.size());
+
+    for (auto& property : snapshot.properties)
+    {
+        stream.writeString(property.name.toString());
+        property.value.writeToStream(stream);
+    }
+
+    stream.writeBool(snapshot.hasEditorSize);
+
+    if (snapshot.hasEditorSize)
+    {
+        stream.writeShort((short) snapshot.editorWidth);
+        stream.writeShort((short) snapshot.editorHeight);
+    }
+
+    stream.writeBool(snapshot.editedGui.isValid());
+
+    if (snapshot.editedGui.isValid())
+        snapshot.editedGui.writeToStream(stream);
+}
+
+bool PluginStateFormat::read(AudioProcessorValueTreeState& parameters, const StoredParameters& stored,
+                             const void* data, int sizeInBytes)
+{
+    Snapshot snapshot;
+
+    if (! parse(stored, data, sizeInBytes, snapshot))
+        return false;
+
+    auto numLaneFields = stored.numLaneFields;
+    auto numLanes = stored.laneFields.size() / numLaneFields;
+
+    //Lanes and fields the session didn't have start from their defaults
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        for (int field = 0; field < numLaneFields; ++field)
+        {
+            auto* parameter = stored.laneFields.getUnchecked(lane * numLaneFields + field);
+
+            if (lane >= snapshot.numLanes || field >= snapshot.numLaneFields)
+                parameter->setValueNotifyingHost(parameter->getDefaultValue());
+            else if (isFloatParameter(*parameter))
+                parameter->setValueNotifyingHost(snapshot.laneFields.getUnchecked(lane * snapshot.numLaneFields + field));
+            else
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(parameter->getNormalisableRange().start
+                                                                          + snapshot.laneFields.getUnchecked(lane * snapshot.numLaneFields + field)));
+        }
+    }
+
+    for (auto* parameter : stored.globals)
+    {
+        auto index = snapshot.globalIDs.indexOf(parameter->paramID);
+        parameter->setValueNotifyingHost(index >= 0 ? snapshot.globalValues.getUnchecked(index) : parameter->getDefaultValue());
+    }
+
+    //Every property of the tree is stored, so one the session doesn't have was set after it was saved
+    auto& state = parameters.state;
+    state.removeAllProperties(nullptr);
+
+    for (auto& property : snapshot.properties)
+        state.setProperty(property.name, property.value, nullptr);
+
+    state.removeChild(state.getChildWithName(editorSizeID), nullptr);
+
+    if (snapshot.hasEditorSize)
+        state.appendChild(ValueTree(editorSizeID, { { widthID, snapshot.editorWidth }, { heightID, snapshot.editorHeight } }), nullptr);
+
+    state.removeChild(state.getChildWithName(guiID), nullptr);
+
+    if (snapshot.editedGui.isValid())
+        state.appendChild(snapshot.editedGui, nullptr);
+
+    return true;
+}
+
+bool PluginStateFormat::parse(const StoredParameters& stored, const void* data, int sizeInBytes, Snapshot& snapshot)
+{
+    auto numLaneFields = stored.numLaneFields;
+    auto numLanes = stored.laneFields.size() / numLaneFields;
+
+    if (! isBinaryState(data, sizeInBytes) || sizeInBytes < 9)
+        return false;
+
+    MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+    stream.readInt();
+
+    auto version = (int) stream.readShort();
+
+    if (version < 1 || version > currentVersion)
+        return false;
+
+    auto storedLanes = (int) (uint16) stream.readShort();
+    auto storedFields = (int) (uint8) stream.readByte();
+
+    //Only the fields known here are kept, of the lanes there are
+    snapshot.numLanes = jmin(storedLanes, numLanes);
+    snapshot.numLaneFields = jmin(storedFields, numLaneFields);
+
+    int knownSize = 0;
+
+    if (version >= 3)
+    {
+        //Widths are as they were written, whatever the ranges are now
+        if (stream.getNumBytesRemaining() < storedFields)
+            return false;
+
+        for (int field = 0; field < storedFields; ++field)
+        {
+            auto size = (uint8) stream.readByte();
+
+            if (size != 1 && size != 2 && size != 4)
+                return false;
+
+            if (field < snapshot.numLaneFields)
+            {
+                snapshot.laneFieldSizes.add(size);
+                knownSize += size;
+            }
+        }
+    }
+    else
+    {
+        //Earlier versions left them to the ranges, which were the same when they were written
+        for (int field = 0; field < snapshot.numLaneFields; ++field)
+        {
+            snapshot.laneFieldSizes.add((uint8) getFieldSize(*stored.laneFields.getUnchecked(field), version));
+            knownSize += snapshot.laneFieldSizes.getLast();
+        }
+    }
+
+    if (stream.getNumBytesRemaining() < 2)
+        return false;
+
+    auto recordSize = (int) (uint16) stream.readShort();
+
+    if (knownSize > recordSize || stream.getNumBytesRemaining() < (int64) storedLanes * recordSize)
+        return false;
+
+    snapshot.laneFields.ensureStorageAllocated(snapshot.numLanes * snapshot.numLaneFields);
+
+    for (int lane = 0; lane < snapshot.numLanes; ++lane)
+    {
+        auto recordEnd = stream.getPosition() + recordSize;
+
+        for (int field = 0; field < snapshot.numLaneFields; ++field)
+        {
+            auto size = snapshot.laneFieldSizes.getUnchecked(field);
+            float value;
+
+            switch (size)
+            {
+                case 1:     value = (float) (uint8) stream.readByte(); break;
+                case 2:     value = (float) (uint16) stream.readShort(); break;
+                default:    value = stream.readFloat(); break;
+            }
+
+            //Version 1 quantised floats to 16 bits
+            if (size == 2 && isFloatParameter(*stored.laneFields.getUnchecked(field)))
+                value /= 65535.0f;
+
+            snapshot.laneFields.add(value);
+        }
+
+        stream.setPosition(recordEnd);
+    }
+
+    stream.setPosition(stream.getPosition() + (int64) (storedLanes - snapshot.numLanes) * recordSize);
+
+    if (stream.getNumBytesRemaining() < 2)
+        return false;
+
+    auto numGlobals = (int) (uint16) stream.readShort();
+
+    for (int i = 0; i < numGlobals; ++i)
+    {
+        auto paramID = stream.readString();
+
+        if (stream.getNumBytesRemaining() < 4)
+            return false;
+
+        auto value = stream.readFloat();
+
+        if (paramID.isNotEmpty())
+        {
+            snapshot.globalIDs.add(paramID);
+            snapshot.globalValues.add(value);
+        }
+    }
+
+    if (stream.getNumBytesRemaining() < 2)
+        return false;
+
+    auto numProperties = (int) (uint16) stream.readShort();
+
+    for (int i = 0; i < numProperties; ++i)
+    {
+        auto name = stream.readString();
+
+        if (stream.isExhausted())
+            return false;
+
+        auto value = var::readFromStream(stream);
+
+        if (name.isNotEmpty())
+            snapshot.properties.set(name, value);
+    }
+
+    if (stream.isExhausted())
+        return false;
+
+    snapshot.hasEditorSize = stream.readBool();
+
+    if (snapshot.hasEditorSize)
+    {
+        if (stream.getNumBytesRemaining() < 4)
+            return false;
+
+        snapshot.editorWidth = stream.readShort();
+        snapshot.editorHeight = stream.readShort();
+    }
+
+    if (stream.isExhausted())
+        return false;
+
+    if (stream.readBool())
+    {
+        snapshot.editedGui = ValueTree::readFromStream(stream);
+
+        if (! snapshot.editedGui.isValid())
+            return false;
+    }
+
+    return true;
+}
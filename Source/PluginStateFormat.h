@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    PluginStateFormat.h
+
+    Compact binary format for the plugin state saved in host sessions.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Writes the plugin state as packed fields instead of the ValueTree the
+    magic state would write.
+
+    Lane parameters take one byte each for switches, choices and small ranges,
+    two for larger ranges and four for floats, which are stored normalised and
+    come back bit exact. Every field's width is written in the header, so a
+    range changed since doesn't misread a session. Version 1 kept floats in
+    two bytes and version 2 left widths to the ranges, both are still read.
+    Global parameters and the state tree's own properties are stored by name,
+    so adding one never breaks older sessions. Reading replaces the tree's
+    properties as a whole, one a session doesn't have is removed. The editor size is always kept,
+    the GUI layout only when it was edited away from the generated default.
+
+    Lane fields are listed lane by lane in the same order for every lane,
+    whether the host sees them or they are kept inside the plugin. New lane
+    fields may only ever be appended: a reader takes the fields it knows and
+    skips the rest of every record, fields a session doesn't have get their
+    default.
+
+    Saving is split in two: capture() copies everything out of the parameters
+    and the state tree on the message thread, write() turns that copy into
+    bytes on any thread.
+*/
+class PluginStateFormat
+{
+public:
+    static constexpr int currentVersion = 3;
+
+    //The parameters a session stores
+    struct StoredParameters
+    {
+        Array<RangedAudioParameter*> laneFields;
+        int numLaneFields = 0;
+        Array<RangedAudioParameter*> globals;
+    };
+
+    //Everything write() needs, lane fields already turned into what gets stored
+    struct Snapshot
+    {
+        int numLanes = 0;
+        int numLaneFields = 0;
+
+        //Normalised values of float fields, steps from the range start of the others
+        Array<float> laneFields;
+        Array<uint8> laneFieldSizes;
+
+        StringArray globalIDs;
+        Array<float> globalValues;
+
+        NamedValueSet properties;
+
+        bool hasEditorSize = false;
+        int editorWidth = 0;
+        int editorHeight = 0;
+
+        //Only valid when the layout was edited away from the default
+        ValueTree editedGui;
+    };
+
+    static bool isBinaryState(const void* data, int sizeInBytes) noexcept;
+
+    //Message thread, the default layout is what magic state's createDefaultGUITree() returns, built once by the caller
+    static Snapshot capture(AudioProcessorValueTreeState& parameters, const StoredParameters& stored,
+                            const ValueTree& defaultGui);
+
+    //Any thread, the snapshot is only read
+    static void write(const Snapshot& snapshot, MemoryBlock& destData);
+
+    static void write(AudioProcessorValueTreeState& parameters, const StoredParameters& stored,
+                      const ValueTree& defaultGui, MemoryBlock& destData)
+    {
+        write(capture(parameters, stored, defaultGui), destData);
+    }
+
+    //Returns false, without touching the state, if the data isn't a whole state this version can read
+    static bool read(AudioProcessorValueTreeState& parameters, const StoredParameters& stored,
+                     const void* data, int sizeInBytes);
+
+private:
+    static int getFieldSize(const RangedAudioParameter& parameter, int version) noexcept;
+
+    //The lanes and fields known here, float fields normalised, returns false if the data is cut short
+    static bool parse(const StoredParameters& stored, const void* data, int sizeInBytes, Snapshot& snapshot);
+};
@@ -0,0 +1,201 @@
+/*
+  ==============================================================================
+
+    PresetBank.cpp
+
+  ==============================================================================
+*/
+
+#include "PresetBank.h"
+
+namespace
+{
+    const char bankMagic[] = { 'S', 'R', 'G', 'B' };
+    const int bankVersion = 2;
+    const int headerSize = 4 + 2 + 2 + 2 + 1;
+
+    //Unit fields only became floats in version 2
+    int getFieldSize(int version, uint8 kind)
+    {
+        return version >= 2 && kind == PresetBank::unitField ? 4 : 2;
+    }
+}
+
+bool PresetBank::load(const File& file, int numLaneFields, const SnapshotBuilder& buildSnapshot)
+{
+    MemoryMappedFile mapped(file, MemoryMappedFile::readOnly);
+    auto* data = static_cast<const uint8*>(mapped.getData());
+    auto size = (int64) mapped.getSize();
+
+    if (data == nullptr || size < headerSize || std::memcmp(data, bankMagic, sizeof(bankMagic)) != 0)
+        return false;
+
+    auto version = (int) ByteOrder::littleEndianShort(data + 4);
+    auto numPrograms = (int) ByteOrder::littleEndianShort(data + 6);
+    auto bankLanes = (int) ByteOrder::littleEndianShort(data + 8);
+    auto bankFields = (int) data[10];
+
+    if (version < 1 || version > bankVersion || bankLanes > LaneSnapshot::maxLanes)
+        return false;
+
+    auto* kinds = data + headerSize;
+
+    if (size < headerSize + bankFields)
+        return false;
+
+    auto laneSize = 0;
+
+    for (int field = 0; field < bankFields; ++field)
+        laneSize += getFieldSize(version, kinds[field]);
+
+    auto programSize = (int64) maxNameLength + (int64) bankLanes * laneSize;
+
+    //Reject a truncated file before anything is built
+    if (size < headerSize + bankFields + numPrograms * programSize)
+        return false;
+
+    std::vector<std::unique_ptr<Program>> newPrograms;
+    std::vector<std::unique_ptr<LaneSnapshot>> newSnapshots;
+
+    for (int index = 0; index < numPrograms; ++index)
+    {
+        auto* record = kinds + bankFields + index * programSize;
+        auto* values = record + maxNameLength;
+
+        auto nameLength = 0;
+
+        while (nameLength < maxNameLength && record[nameLength] != 0)
+            ++nameLength;
+
+        auto program = std::make_unique<Program>();
+        program->name = String::fromUTF8(reinterpret_cast<const char*>(record), nameLength);
+        program->fields.ensureStorageAllocated(bankLanes * numLaneFields);
+
+        //Fields the bank doesn't have are NaN, the builder gives them their default
+        for (int lane = 0; lane < bankLanes; ++lane)
+        {
+            auto* value = values + lane * laneSize;
+
+            for (int field = 0; field < numLaneFields; ++field)
+            {
+                if (field >= bankFields)
+                {
+                    program->fields.add(std::numeric_limits<float>::quiet_NaN());
+                    continue;
+                }
+
+                auto fieldSize = getFieldSize(version, kinds[field]);
+
+                if (fieldSize == 4)
+                {
+                    auto bits = ByteOrder::littleEndianInt(value);
+                    float unitValue;
+                    std::memcpy(&unitValue, &bits, sizeof(unitValue));
+                    program->fields.add(unitValue);
+                }
+                else
+                {
+                    auto plain = (float) ByteOrder::littleEndianShort(value);
+                    program->fields.add(kinds[field] == unitField ? plain / 65535.0f : plain);
+                }
+
+                value += fieldSize;
+            }
+        }
+
+        auto snapshot = std::make_unique<LaneSnapshot>();
+        buildSnapshot(*program, *snapshot);
+
+        newPrograms.push_back(std::move(program));
+        newSnapshots.push_back(std::move(snapshot));
+    }
+
+    numLanes = bankLanes;
+    programs = std::move(newPrograms);
+
+    RetiredBank retired;
+    retired.snapshots = std::move(snapshots);
+    retiredBanks.push_back(std::move(retired));
+
+    snapshots = std::move(newSnapshots);
+
+    return true;
+}
+
+bool PresetBank::contains(const LaneSnapshot* snapshot) const noexcept
+{
+    for (auto& own : snapshots)
+        if (own.get() == snapshot)
+            return true;
+
+    return false;
+}
+
+void PresetBank::stampRetired(uint32 stamp)
+{
+    for (auto& bank : retiredBanks)
+    {
+        if (! bank.isStamped)
+        {
+            bank.stamp = stamp;
+            bank.isStamped = true;
+        }
+    }
+}
+
+void PresetBank::releaseRetired(const BlockEpoch& epoch, const std::atomic<const LaneSnapshot*>& snapshotInUse)
+{
+    auto isReachable = [&](const RetiredBank& bank)
+    {
+        if (! bank.isStamped || ! epoch.hasPassed(bank.stamp))
+            return true;
+
+        //Read after the stamp has passed, so it already covers a snapshot the last block picked up
+        auto* inUse = snapshotInUse.load();
+
+        for (auto& snapshot : bank.snapshots)
+            if (snapshot.get() == inUse)
+                return true;
+
+        return false;
+    };
+
+    retiredBanks.erase(std::remove_if(retiredBanks.begin(), retiredBanks.end(), [&](const RetiredBank& bank) { return ! isReachable(bank); }),
+                       retiredBanks.end());
+}
+
+bool PresetBank::save(const File& file, const Array<Program>& programsToSave, int numLanesToSave, const Array<FieldKind>& fieldKinds)
+{
+    MemoryOutputStream stream;
+
+    stream.write(bankMagic, sizeof(bankMagic));
+    stream.writeShort((short) bankVersion);
+    stream.writeShort((short) programsToSave.size());
+    stream.writeShort((short) numLanesToSave);
+    stream.writeByte((char) fieldKinds.size());
+
+    for (auto kind : fieldKinds)
+        stream.writeByte((char) kind);
+
+    for (auto& program : programsToSave)
+    {
+        char name[maxNameLength] = {};
+        program.name.copyToUTF8(name, maxNameLength);
+        stream.write(name, maxNameLength);
+
+        for (int lane = 0; lane < numLanesToSave; ++lane)
+        {
+            for (int field = 0; field < fieldKinds.size(); ++field)
+            {
+                auto value = program.fields[lane * fieldKinds.size() + field];
+
+                if (fieldKinds[field] == unitField)
+                    stream.writeFloat(jlimit(0.0f, 1.0f, value));
+                else
+                    stream.writeShort((short) jlimit(0, 65535, roundToInt(value)));
+            }
+        }
+    }
+
+    return file.replaceWithData(stream.getData(), stream.getDataSize());
+}
@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    PresetBank.h
+
+    Programs read from one memory mapped bank file, each prebuilt into the
+    lane snapshot the audio thread plays.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BlockEpoch.h"
+#include "LaneSnapshot.h"
+
+//==============================================================================
+/**
+    A bank file is a header followed by one packed record per program:
+
+        "SRGB", uint16 version, uint16 programs, uint16 lanes, uint8 fields,
+        one uint8 kind per field, then for every program a 32 byte name and
+        lanes * fields values
+
+    Fields are the lane parameters in their processor order. An integer field
+    holds the plain value as a uint16, a unit field a value from 0 to 1 as a
+    float, so it loads bit exact. Version 1 banks scaled unit fields to the
+    full uint16 range and are still read. All values are little endian.
+
+    The whole file is validated and turned into snapshots when it loads, so
+    switching programs later only hands a finished snapshot over. The bank a
+    load replaces is kept until the audio thread can't reach its snapshots.
+*/
+class PresetBank
+{
+public:
+    static constexpr int maxNameLength = 32;
+
+    enum FieldKind
+    {
+        integerField = 0,
+        unitField = 1
+    };
+
+    struct Program
+    {
+        String name;
+
+        //Plain parameter values, every field of lane 0, then lane 1 and so on
+        Array<float> fields;
+    };
+
+    //Fills a snapshot from a program, values still have to be checked against the parameters
+    using SnapshotBuilder = std::function<void(const Program&, LaneSnapshot&)>;
+
+    //Message thread, keeps the current bank if the file can't be read
+    bool load(const File& file, int numLaneFields, const SnapshotBuilder& buildSnapshot);
+
+    //Message thread, stamps the replaced banks once nothing shared points into them any more
+    void stampRetired(uint32 stamp);
+
+    //Message thread, frees the stamped banks whose stamp has passed and that don't hold the snapshot the audio thread plays from
+    void releaseRetired(const BlockEpoch& epoch, const std::atomic<const LaneSnapshot*>& snapshotInUse);
+
+    static bool save(const File& file, const Array<Program>& programs, int numLanes, const Array<FieldKind>& fieldKinds);
+
+    int getNumPrograms() const noexcept { return (int) programs.size(); }
+    int getNumLanes() const noexcept { return numLanes; }
+
+    const Program& getProgram(int index) const { return *programs[(size_t) index]; }
+    const LaneSnapshot& getSnapshot(int index) const noexcept { return *snapshots[(size_t) index]; }
+
+    //Whether the snapshot belongs to the current bank
+    bool contains(const LaneSnapshot* snapshot) const noexcept;
+
+private:
+    int numLanes = 0;
+    std::vector<std::unique_ptr<Program>> programs;
+    std::vector<std::unique_ptr<LaneSnapshot>> snapshots;
+
+    //Banks that were replaced, the audio thread may still be reading one of their snapshots
+    struct RetiredBank
+    {
+        std::vector<std::unique_ptr<LaneSnapshot>> snapshots;
+        uint32 stamp = 0;
+        bool isStamped = false;
+    };
+
+    std::vector<RetiredBank> retiredBanks;
+};
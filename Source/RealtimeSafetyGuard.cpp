@@ -0,0 +1,254 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyGuard.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeSafetyGuard.h"
+
+#if RHYTHM_GENERATOR_REALTIME_GUARD
+ #include <cstdint>
+ #include <cstdlib>
+ #include <new>
+
+ #if JUCE_LINUX
+  #include <dlfcn.h>
+  #include <pthread.h>
+ #endif
+#endif
+
+const char* RealtimeSafetyGuard::getViolationName(ViolationType type) noexcept
+{
+    switch (type)
+    {
+        case allocation:    return "allocation";
+        case deallocation:  return "deallocation";
+        case mutexLock:     return "mutex lock";
+        default:            return "unknown";
+    }
+}
+
+#if RHYTHM_GENERATOR_REALTIME_GUARD
+
+namespace
+{
+    thread_local int realtimeDepth = 0;
+
+    //Set while a violation is being recorded, so capturing the stack isn't reported again
+    thread_local bool isRecording = false;
+
+    std::atomic<int64> violationCounts[RealtimeSafetyGuard::numViolationTypes];
+
+    const int maxReports = 32;
+    SpinLock reportLock;
+
+    StringArray& getReports()
+    {
+        static StringArray reports;
+        return reports;
+    }
+}
+
+RealtimeSafetyGuard::ScopedRealtimeSection::ScopedRealtimeSection(bool isRealtime) noexcept : active(isRealtime)
+{
+    if (active)
+        ++realtimeDepth;
+}
+
+RealtimeSafetyGuard::ScopedRealtimeSection::~ScopedRealtimeSection() noexcept
+{
+    if (active)
+        --realtimeDepth;
+}
+
+void RealtimeSafetyGuard::reportViolation(ViolationType type) noexcept
+{
+    if (realtimeDepth == 0 || isRecording)
+        return;
+
+    isRecording = true;
+
+    auto count = ++violationCounts[type];
+
+    if (count <= maxReports)
+    {
+        auto report = String(getViolationName(type)) + newLine + SystemStats::getStackBacktrace();
+
+        const SpinLock::ScopedLockType lock(reportLock);
+
+        if (getReports().size() < maxReports)
+            getReports().add(report);
+    }
+
+    isRecording = false;
+}
+
+int64 RealtimeSafetyGuard::getNumViolations(ViolationType type) noexcept
+{
+    return violationCounts[type].load();
+}
+
+StringArray RealtimeSafetyGuard::getViolationReports()
+{
+    const SpinLock::ScopedLockType lock(reportLock);
+    return getReports();
+}
+
+void RealtimeSafetyGuard::reset()
+{
+    const SpinLock::ScopedLockType lock(reportLock);
+
+    for (auto& count : violationCounts)
+        count = 0;
+
+    getReports().clear();
+}
+
+//==============================================================================
+namespace
+{
+    void* guardedAllocate(std::size_t size)
+    {
+        RealtimeSafetyGuard::reportViolation(RealtimeSafetyGuard::allocation);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void guardedFree(void* ptr) noexcept
+    {
+        if (ptr != nullptr)
+            RealtimeSafetyGuard::reportViolation(RealtimeSafetyGuard::deallocation);
+
+        std::free(ptr);
+    }
+
+   #if __cpp_aligned_new
+    //Over allocates and keeps the pointer malloc returned just in front of the aligned block
+    void* guardedAllocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        RealtimeSafetyGuard::reportViolation(RealtimeSafetyGuard::allocation);
+
+        auto align = jmax((std::size_t) alignment, sizeof(void*));
+        auto* raw = static_cast<char*>(std::malloc(size + align + sizeof(void*)));
+
+        if (raw == nullptr)
+            return nullptr;
+
+        auto aligned = ((std::uintptr_t) (raw + sizeof(void*)) + align - 1) & ~(std::uintptr_t) (align - 1);
+        auto* ptr = reinterpret_cast<void*>(aligned);
+        static_cast<void**>(ptr)[-1] = raw;
+        return ptr;
+    }
+
+    void guardedFreeAligned(void* ptr) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        RealtimeSafetyGuard::reportViolation(RealtimeSafetyGuard::deallocation);
+        std::free(static_cast<void**>(ptr)[-1]);
+    }
+   #endif
+}
+
+void* operator new(std::size_t size)
+{
+    if (auto* ptr = guardedAllocate(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (auto* ptr = guardedAllocate(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept    { return guardedAllocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept  { return guardedAllocate(size); }
+
+void operator delete(void* ptr) noexcept                                { guardedFree(ptr); }
+void operator delete[](void* ptr) noexcept                              { guardedFree(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                   { guardedFree(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept                 { guardedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept         { guardedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept       { guardedFree(ptr); }
+
+#if __cpp_aligned_new
+//Types declared with a larger alignas than the default, such as blocks of lane arrays
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (auto* ptr = guardedAllocateAligned(size, alignment))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    if (auto* ptr = guardedAllocateAligned(size, alignment))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept    { return guardedAllocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept  { return guardedAllocateAligned(size, alignment); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept                                  { guardedFreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept                                { guardedFreeAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept                     { guardedFreeAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept                   { guardedFreeAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept           { guardedFreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept         { guardedFreeAligned(ptr); }
+#endif
+
+//==============================================================================
+#if JUCE_LINUX
+namespace
+{
+    using LockFunction = int (*)(pthread_mutex_t*);
+    LockFunction realLock = nullptr;
+
+    //Resolved when the binary loads, ahead of every other static initialiser, so no lock ever
+    //has to run a static guard or dlsym, either of which can lock or allocate themselves
+    __attribute__((constructor(101))) void resolveRealLock()
+    {
+        realLock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+    }
+}
+
+//Interposes the libc symbol, CriticalSection, std::mutex and most of the host's locks end up here
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    //Going on without the real function would leave the caller unlocked, so stop instead
+    if (realLock == nullptr)
+        std::abort();
+
+    RealtimeSafetyGuard::reportViolation(RealtimeSafetyGuard::mutexLock);
+    return realLock(mutex);
+}
+#endif
+
+#else
+
+int64 RealtimeSafetyGuard::getNumViolations(ViolationType) noexcept    { return 0; }
+StringArray RealtimeSafetyGuard::getViolationReports()                 { return {}; }
+void RealtimeSafetyGuard::reset()                                       {}
+void RealtimeSafetyGuard::reportViolation(ViolationType) noexcept      {}
+
+#endif
+
+int64 RealtimeSafetyGuard::getTotalNumViolations() noexcept
+{
+    int64 total = 0;
+
+    for (int type = 0; type < numViolationTypes; ++type)
+        total += getNumViolations((ViolationType) type);
+
+    return total;
+}
@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyGuard.h
+
+    Debug hooks that catch allocations and locks on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//Replaces the global allocation functions and, on Linux, pthread_mutex_lock. Only enable
+//this in test and benchmark builds, the hooks are process wide and would also see the host
+#ifndef RHYTHM_GENERATOR_REALTIME_GUARD
+ #define RHYTHM_GENERATOR_REALTIME_GUARD 0
+#endif
+
+//==============================================================================
+/**
+    Counts every heap allocation, deallocation and mutex lock made by a thread
+    while it is inside a ScopedRealtimeSection, and keeps the stack of the
+    first few of them.
+
+    With RHYTHM_GENERATOR_REALTIME_GUARD off, the sections compile to nothing
+    and the counters always read zero.
+*/
+class RealtimeSafetyGuard
+{
+public:
+    enum ViolationType
+    {
+        allocation,
+        deallocation,
+        mutexLock,
+        numViolationTypes
+    };
+
+    //Marks the calling thread as realtime until it goes out of scope, sections can nest
+    class ScopedRealtimeSection
+    {
+    public:
+        explicit ScopedRealtimeSection(bool isRealtime = true) noexcept;
+        ~ScopedRealtimeSection() noexcept;
+
+    private:
+        bool active;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+    };
+
+    static constexpr bool isEnabled() noexcept { return RHYTHM_GENERATOR_REALTIME_GUARD != 0; }
+
+    static int64 getNumViolations(ViolationType type) noexcept;
+    static int64 getTotalNumViolations() noexcept;
+
+    //One entry per recorded violation, its type followed by the stack it was made from
+    static StringArray getViolationReports();
+
+    static void reset();
+
+    //Called by the hooks, does nothing outside a realtime section
+    static void reportViolation(ViolationType type) noexcept;
+
+    static const char* getViolationName(ViolationType type) noexcept;
+};
+
+//==============================================================================
+#if ! RHYTHM_GENERATOR_REALTIME_GUARD
+
+inline RealtimeSafetyGuard::ScopedRealtimeSection::ScopedRealtimeSection(bool) noexcept : active(false) {}
+inline RealtimeSafetyGuard::ScopedRealtimeSection::~ScopedRealtimeSection() noexcept {}
+
+#endif
@@ -0,0 +1,220 @@
+/*
+  ==============================================================================
+
+    RhythmAlgorithms.cpp
+
+  ==============================================================================
+*/
+
+#include "RhythmAlgorithms.h"
+
+#include <utility>
+
+namespace
+{
+    void clampSettings(int& pulses, int& steps) noexcept
+    {
+        steps = steps < 0 ? 0 : (steps > StepPattern::maxSteps ? StepPattern::maxSteps : steps);
+        pulses = pulses < 0 ? 0 : (pulses > steps ? steps : pulses);
+    }
+
+    //==============================================================================
+    //Fixed density necklaces in lexicographic order, by the FKM prenecklace recursion
+    //pruned to branches that can still end up with exactly the wanted number of ones
+    struct NecklaceSearch
+    {
+        static constexpr int maxVisits = 200000;
+
+        int length;
+        int ones;
+        int wanted;
+        int found = 0;
+        int visits = 0;
+        unsigned char word[StepPattern::maxSteps + 1] = {};
+
+        bool search(int t, int p, int onesSoFar) noexcept
+        {
+            if (++visits > maxVisits)
+                return false;
+
+            if (t > length)
+                return length % p == 0 && onesSoFar == ones && found++ == wanted;
+
+            auto remaining = length - t + 1;
+
+            for (int symbol = word[t - p]; symbol <= 1; ++symbol)
+            {
+                auto newOnes = onesSoFar + symbol;
+
+                if (newOnes > ones || newOnes + remaining - 1 < ones)
+                    continue;
+
+                word[t] = static_cast<unsigned char>(symbol);
+
+                if (search(t + 1, symbol == word[t - p] ? p : t, newOnes))
+                    return true;
+            }
+
+            return false;
+        }
+    };
+
+    //==============================================================================
+    //Small xorshift generator, only used at build time so the same seed always gives the same fill
+    struct FillRandom
+    {
+        uint32_t state;
+
+        explicit FillRandom(int seed) noexcept : state(0x9E3779B9u ^ (static_cast<uint32_t>(seed) * 0x85EBCA6Bu)) { next(); }
+
+        uint32_t next() noexcept
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+    };
+
+    //==============================================================================
+    template <int... indices>
+    StepPattern dispatch(int index, const PatternSettings& settings, std::integer_sequence<int, indices...>) noexcept
+    {
+        using Generator = StepPattern (*)(const PatternSettings&);
+        static constexpr Generator generators[] = { &PatternGenerator<static_cast<RhythmAlgorithm>(indices)>::generate... };
+
+        return generators[index](settings);
+    }
+}
+
+//==============================================================================
+StepPattern PatternGenerator<RhythmAlgorithm::euclidean>::generate(const PatternSettings& settings) noexcept
+{
+    return StepPattern::euclidean(settings.pulses, settings.steps);
+}
+
+StepPattern PatternGenerator<RhythmAlgorithm::necklace>::generate(const PatternSettings& settings) noexcept
+{
+    auto pulses = settings.pulses;
+    auto steps = settings.steps;
+    clampSettings(pulses, steps);
+
+    if (steps == 0)
+        return {};
+
+    NecklaceSearch necklace { steps, pulses, settings.variation < 0 ? 0 : settings.variation };
+
+    //When there are fewer necklaces than the variation asks for, count round again from the first
+    if (! necklace.search(1, 1, 0))
+    {
+        if (necklace.found == 0 || necklace.visits > NecklaceSearch::maxVisits)
+            return StepPattern::euclidean(pulses, steps);
+
+        NecklaceSearch wrapped { steps, pulses, necklace.wanted % necklace.found };
+
+        if (! wrapped.search(1, 1, 0))
+            return StepPattern::euclidean(pulses, steps);
+
+        necklace = wrapped;
+    }
+
+    //The lexicographically smallest rotation starts with its rests, reversed it starts on a pulse
+    auto pattern = StepPattern::rests(steps);
+
+    for (int i = 0; i < steps; ++i)
+        pattern.setStep(i, necklace.word[steps - i] != 0);
+
+    return pattern;
+}
+
+StepPattern PatternGenerator<RhythmAlgorithm::clapping>::generate(const PatternSettings& settings) noexcept
+{
+    auto pulses = settings.pulses;
+    auto steps = settings.steps;
+    clampSettings(pulses, steps);
+
+    if (steps == 0)
+        return {};
+
+    auto cell = StepPattern::euclidean(pulses, steps);
+
+    //One cycle of the cell per shift, as many as fit, like the second part of Clapping Music
+    auto numCycles = StepPattern::maxSteps / steps;
+
+    if (numCycles > steps)
+        numCycles = steps;
+
+    auto shiftPerCycle = 1 + (settings.variation < 0 ? 0 : settings.variation);
+
+    auto pattern = StepPattern::rests(numCycles * steps);
+
+    for (int cycle = 0; cycle < numCycles; ++cycle)
+    {
+        auto shift = (cycle * shiftPerCycle) % steps;
+
+        for (int i = 0; i < steps; ++i)
+            pattern.setStep(cycle * steps + i, cell.isPulse((i + shift) % steps));
+    }
+
+    return pattern;
+}
+
+StepPattern PatternGenerator<RhythmAlgorithm::randomFill>::generate(const PatternSettings& settings) noexcept
+{
+    auto pulses = settings.pulses;
+    auto steps = settings.steps;
+    clampSettings(pulses, steps);
+
+    if (steps == 0)
+        return {};
+
+    //Step 0 weighs the most, then every power of two subdivision half as much as the one above
+    uint32_t weights[StepPattern::maxSteps];
+    uint32_t totalWeight = 0;
+
+    for (int i = 0; i < steps; ++i)
+    {
+        auto level = 0;
+
+        for (auto index = i == 0 ? StepPattern::maxSteps : i; (index & 1) == 0 && level < 8; index >>= 1)
+            ++level;
+
+        weights[i] = 1u << level;
+        totalWeight += weights[i];
+    }
+
+    FillRandom random(settings.variation);
+    auto pattern = StepPattern::rests(steps);
+
+    //Weighted draws without replacement, a chosen step's weight drops out of the total
+    for (int pulse = 0; pulse < pulses; ++pulse)
+    {
+        auto target = random.next() % totalWeight;
+        auto step = 0;
+
+        for (; step < steps - 1; ++step)
+        {
+            if (target < weights[step])
+                break;
+
+            target -= weights[step];
+        }
+
+        pattern.setStep(step, true);
+        totalWeight -= weights[step];
+        weights[step] = 0;
+    }
+
+    return pattern;
+}
+
+//==============================================================================
+StepPattern generatePattern(RhythmAlgorithm algorithm, const PatternSettings& settings) noexcept
+{
+    auto index = static_cast<int>(algorithm);
+
+    if (index < 0 || index >= static_cast<int>(RhythmAlgorithm::numAlgorithms))
+        index = 0;
+
+    return dispatch(index, settings, std::make_integer_sequence<int, static_cast<int>(RhythmAlgorithm::numAlgorithms)>());
+}
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    RhythmAlgorithms.h
+
+    The generators a lane can build its pattern with.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "StepPattern.h"
+
+//==============================================================================
+/**
+    Every algorithm is a specialisation of PatternGenerator with a static
+    generate() that turns the lane's settings into a StepPattern. Patterns are
+    built on the message thread when a setting changes, the audio thread only
+    ever reads the cached bits, whichever algorithm made them.
+
+    To add a generator, add it to RhythmAlgorithm before numAlgorithms, write
+    its specialisation and give it a name in the processor's algorithm list.
+    generatePattern() picks it up through its compile time table.
+*/
+enum class RhythmAlgorithm
+{
+    euclidean,      //Bjorklund's even spread of pulses over steps
+    necklace,       //The variation'th binary necklace with that many pulses
+    clapping,       //The Euclidean cell phasing against itself, one step further every cycle
+    randomFill,     //Pulses drawn with weight on the strong beats, the variation is the seed
+    numAlgorithms
+};
+
+struct PatternSettings
+{
+    int pulses = 4;
+    int steps = 8;
+    int variation = 0;
+};
+
+template <RhythmAlgorithm algorithm>
+struct PatternGenerator;
+
+template <>
+struct PatternGenerator<RhythmAlgorithm::euclidean>
+{
+    static StepPattern generate(const PatternSettings& settings) noexcept;
+};
+
+template <>
+struct PatternGenerator<RhythmAlgorithm::necklace>
+{
+    static StepPattern generate(const PatternSettings& settings) noexcept;
+};
+
+template <>
+struct PatternGenerator<RhythmAlgorithm::clapping>
+{
+    static StepPattern generate(const PatternSettings& settings) noexcept;
+};
+
+template <>
+struct PatternGenerator<RhythmAlgorithm::randomFill>
+{
+    static StepPattern generate(const PatternSettings& settings) noexcept;
+};
+
+//Builds the pattern with the given algorithm, out of range algorithms fall back to Euclidean
+StepPattern generatePattern(RhythmAlgorithm algorithm, const PatternSettings& settings) noexcept;
@@ -0,0 +1,281 @@
+/*
+  ==============================================================================
+
+    RhythmEngine.cpp
+
+  ==============================================================================
+*/
+
+#include "RhythmEngine.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #define RHYTHM_ENGINE_USE_SSE2 1
+ #include <emmintrin.h>
+#else
+ #define RHYTHM_ENGINE_USE_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+ #include <intrin.h>
+#endif
+
+static_assert(RhythmEngine::maxLanes % 8 == 0, "findDueLanes compares 8 lanes per iteration");
+static_assert(RhythmEngine::maxLanes <= 64, "Lane sets are stored in 64 bit masks");
+
+//A pulse plays when the lane's 32 bit draw is below its threshold, so this one always plays
+static constexpr uint64_t probabilityOne = uint64_t(1) << 32;
+
+RhythmEngine::RhythmEngine() noexcept
+{
+    for (int lane = 0; lane < maxLanes; ++lane)
+    {
+        nextStepPpq[lane] = 0.0;
+        stepLengthPpq[lane] = 0.5;
+        nextStep[lane] = 0;
+        gateLength[lane] = 0.5;
+        notes[lane] = 36;
+        probabilityThreshold[lane] = probabilityOne;
+        velocities[lane] = 127;
+        accents[lane] = 0.0;
+        morphPosition[lane] = 0.0;
+        morphTarget[lane] = 0.0;
+    }
+}
+
+void RhythmEngine::prepare(double sampleRate) noexcept
+{
+    scheduler.prepare(sampleRate);
+    unsyncedLanes = ~uint64_t(0);
+
+    //Sample times of held notes don't carry over a new sample rate
+    releaseAllPending = true;
+}
+
+void RhythmEngine::setNumLanes(int newNumLanes) noexcept
+{
+    numLanes = newNumLanes < 0 ? 0 : (newNumLanes > maxLanes ? maxLanes : newNumLanes);
+
+    //Lanes past the end can never be enabled
+    if (numLanes < maxLanes)
+        enabledLanes &= (uint64_t(1) << numLanes) - 1;
+}
+
+void RhythmEngine::setLaneEnabled(int lane, bool shouldBeEnabled) noexcept
+{
+    if (lane < 0 || lane >= numLanes)
+        return;
+
+    auto bit = uint64_t(1) << lane;
+
+    if (shouldBeEnabled)
+    {
+        //Find its place again from the playhead when switched back on
+        if ((enabledLanes & bit) == 0)
+            unsyncedLanes |= bit;
+
+        enabledLanes |= bit;
+    }
+    else
+    {
+        enabledLanes &= ~bit;
+    }
+}
+
+void RhythmEngine::setLaneStepLength(int lane, double newStepLengthPpq) noexcept
+{
+    if (newStepLengthPpq <= 0.0 || newStepLengthPpq == stepLengthPpq[lane])
+        return;
+
+    stepLengthPpq[lane] = newStepLengthPpq;
+    unsyncedLanes |= uint64_t(1) << lane;
+}
+
+void RhythmEngine::setLaneProbability(int lane, double probability) noexcept
+{
+    probability = probability < 0.0 ? 0.0 : (probability > 1.0 ? 1.0 : probability);
+    probabilityThreshold[lane] = static_cast<uint64_t>(probability * static_cast<double>(probabilityOne));
+}
+
+void RhythmEngine::setLaneVelocity(int lane, int newVelocity, double newAccent) noexcept
+{
+    velocities[lane] = newVelocity < 1 ? 1 : (newVelocity > 127 ? 127 : newVelocity);
+    accents[lane] = newAccent < 0.0 ? 0.0 : (newAccent > 1.0 ? 1.0 : newAccent);
+}
+
+void RhythmEngine::setLanePattern(int lane, const StepPattern& newPattern) noexcept
+{
+    patterns[lane] = newPattern;
+    updateLadderMatch(lane);
+}
+
+void RhythmEngine::setLaneMorph(int lane, double amount) noexcept
+{
+    morphTarget[lane] = amount < 0.0 ? 0.0 : (amount > 1.0 ? 1.0 : amount);
+}
+
+void RhythmEngine::setLaneMorphTarget(int lane, const StepPattern& newTarget) noexcept
+{
+    morphTargetPatterns[lane] = newTarget;
+    updateLadderMatch(lane);
+}
+
+void RhythmEngine::setMorphLadders(const MorphLadders* newLadders) noexcept
+{
+    morphLadders = newLadders;
+
+    for (int lane = 0; lane < maxLanes; ++lane)
+        updateLadderMatch(lane);
+}
+
+void RhythmEngine::updateLadderMatch(int lane) noexcept
+{
+    auto bit = uint64_t(1) << lane;
+
+    //A ladder left from other patterns, a program's or the parameters', would morph the wrong pattern
+    const auto* ladder = morphLadders != nullptr ? &morphLadders->lanes[lane] : nullptr;
+
+    if (ladder != nullptr && ladder->isReady && ladder->from == patterns[lane] && ladder->to == morphTargetPatterns[lane])
+        matchingLadders |= bit;
+    else
+        matchingLadders &= ~bit;
+}
+
+void RhythmEngine::setRandomSeed(uint64_t newSeed) noexcept
+{
+    if (newSeed == randomSeed)
+        return;
+
+    randomSeed = newSeed;
+    unsyncedLanes = ~uint64_t(0);
+}
+
+void RhythmEngine::setGroove(const GrooveTable& newGroove) noexcept
+{
+    auto changed = newGroove.length != groove.length;
+
+    for (int i = 0; i < newGroove.length && ! changed; ++i)
+        changed = newGroove.timing[i] != groove.timing[i] || newGroove.velocity[i] != groove.velocity[i];
+
+    if (! changed)
+        return;
+
+    groove = newGroove;
+
+    //Moving the next steps rather than resyncing never plays a step twice, one moved into the past plays right away
+    for (int lane = 0; lane < maxLanes; ++lane)
+        nextStepPpq[lane] = getStepPpq(lane, nextStep[lane]);
+}
+
+void RhythmEngine::applySnapshot(const LaneSnapshot& snapshot) noexcept
+{
+    setRandomSeed(snapshot.randomSeed);
+    setGroove(snapshot.groove);
+    setMorphLength(snapshot.morphLengthBars);
+    applyLaneConfigs(snapshot);
+}
+
+void RhythmEngine::applyLaneConfigs(const LaneSnapshot& snapshot) noexcept
+{
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        if (lane >= snapshot.numLanes)
+        {
+            setLaneEnabled(lane, false);
+            continue;
+        }
+
+        const auto& config = snapshot.lanes[lane];
+
+        setLaneEnabled(lane, config.enabled);
+        setLaneNote(lane, config.noteNumber);
+        setLaneStepLength(lane, config.stepLengthPpq);
+        setLaneGate(lane, config.gateLength);
+        setLanePattern(lane, config.pattern);
+        setLaneMorphTarget(lane, config.morphTarget);
+        setLaneProbability(lane, config.probability);
+        setLaneVelocity(lane, config.velocity, config.accent);
+        setLaneMorph(lane, config.morph);
+    }
+}
+
+void RhythmEngine::syncLanes(uint64_t lanes) noexcept
+{
+    unsyncedLanes &= ~lanes;
+
+    while (lanes != 0)
+    {
+        auto lane = findLowestLane(lanes);
+        lanes &= lanes - 1;
+
+        auto step = scheduler.getFirstStepInWindow(stepLengthPpq[lane], phaseOriginPpq);
+        auto windowStartPpq = scheduler.getWindowStartPpq();
+
+        //Grooved steps move less than half a step, so the first one in the window is a neighbour of the straight one
+        if (getStepPpq(lane, step - 1) >= windowStartPpq)
+            --step;
+        else if (getStepPpq(lane, step) < windowStartPpq)
+            ++step;
+
+        nextStep[lane] = step;
+        nextStepPpq[lane] = getStepPpq(lane, step);
+        random[lane].seed(randomSeed, lane, nextStep[lane]);
+    }
+}
+
+int RhythmEngine::getStepVelocity(int lane, int stepIndex) const noexcept
+{
+    //Step 0 is the strongest, then every power of two subdivision is softened a bit more
+    auto level = 0;
+
+    for (auto index = stepIndex == 0 ? 16 : stepIndex; (index & 1) == 0 && level < 4; index >>= 1)
+        ++level;
+
+    auto scale = 1.0 - accents[lane] * 0.75 * (4 - level) / 4.0;
+    auto velocity = static_cast<int>(velocities[lane] * scale + 0.5);
+
+    return velocity < 1 ? 1 : velocity;
+}
+
+uint64_t RhythmEngine::findDueLanes(double windowEndPpq) const noexcept
+{
+    uint64_t dueLanes = 0;
+
+   #if RHYTHM_ENGINE_USE_SSE2
+    auto windowEnd = _mm_set1_pd(windowEndPpq);
+
+    for (int lane = 0; lane < numLanes; lane += 8)
+    {
+        auto due01 = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(nextStepPpq + lane), windowEnd));
+        auto due23 = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(nextStepPpq + lane + 2), windowEnd));
+        auto due45 = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(nextStepPpq + lane + 4), windowEnd));
+        auto due67 = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(nextStepPpq + lane + 6), windowEnd));
+
+        auto due = static_cast<uint64_t>(due01 | (due23 << 2) | (due45 << 4) | (due67 << 6));
+        dueLanes |= due << lane;
+    }
+   #else
+    for (int lane = 0; lane < numLanes; ++lane)
+        dueLanes |= static_cast<uint64_t>(nextStepPpq[lane] < windowEndPpq) << lane;
+   #endif
+
+    return dueLanes & enabledLanes;
+}
+
+int RhythmEngine::findLowestLane(uint64_t lanes) noexcept
+{
+   #if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, lanes);
+    return static_cast<int>(index);
+   #elif defined(_MSC_VER)
+    unsigned long index;
+
+    if (_BitScanForward(&index, static_cast<unsigned long>(lanes)))
+        return static_cast<int>(index);
+
+    _BitScanForward(&index, static_cast<unsigned long>(lanes >> 32));
+    return static_cast<int>(index) + 32;
+   #else
+    return __builtin_ctzll(lanes);
+   #endif
+}
@@ -0,0 +1,454 @@
+/*
+  ==============================================================================
+
+    RhythmEngine.h
+
+    Lane state for all rhythms, laid out as arrays so the per block work runs
+    over contiguous memory.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "GrooveTable.h"
+#include "LaneRandom.h"
+#include "LaneSnapshot.h"
+#include "NoteReleaseQueue.h"
+#include "PatternMorph.h"
+#include "StepScheduler.h"
+
+//==============================================================================
+/**
+    Plays up to maxLanes rhythms, each with its own pattern, note and step length.
+
+    Every lane field lives in its own array indexed by lane, and lane sets are
+    64 bit masks. Finding the lanes with a step in the block is a single SIMD
+    compare of all next step positions against the end of the block, 8 lanes
+    per iteration, so a block only visits lanes that actually fire.
+*/
+class RhythmEngine
+{
+public:
+    static constexpr int maxLanes = LaneSnapshot::maxLanes;
+
+    RhythmEngine() noexcept;
+
+    void prepare(double sampleRate) noexcept;
+
+    void setNumLanes(int newNumLanes) noexcept;
+    int getNumLanes() const noexcept { return numLanes; }
+
+    //==============================================================================
+    void setLaneEnabled(int lane, bool shouldBeEnabled) noexcept;
+    void setLaneNote(int lane, int noteNumber) noexcept { notes[lane] = noteNumber; }
+    void setLaneStepLength(int lane, double newStepLengthPpq) noexcept;
+    void setLanePattern(int lane, const StepPattern& newPattern) noexcept;
+
+    //Length of a note as a fraction of the lane's step
+    void setLaneGate(int lane, double fractionOfStep) noexcept { gateLength[lane] = fractionOfStep; }
+
+    //Chance from 0 to 1 that a pulse plays
+    void setLaneProbability(int lane, double probability) noexcept;
+
+    //Velocity of the strongest step, accent from 0 to 1 softens the others by their metric level
+    void setLaneVelocity(int lane, int newVelocity, double newAccent) noexcept;
+
+    //Lanes reseed their generators from this whenever they find their place
+    void setRandomSeed(uint64_t newSeed) noexcept;
+
+    //Shifts and scales every lane's steps, lanes keep their place when it changes
+    void setGroove(const GrooveTable& newGroove) noexcept;
+
+    //Amount from 0 to 1 the lane glides to, one step at a time
+    void setLaneMorph(int lane, double amount) noexcept;
+    //In bars of the time signature the transport gives
+    void setMorphLength(double barsForFullMorph) noexcept { morphLengthBars = barsForFullMorph; }
+
+    //The pattern a morph of 1 plays, a lane only uses a ladder built from its own pattern to this one
+    void setLaneMorphTarget(int lane, const StepPattern& newTarget) noexcept;
+
+    //Patterns played while a lane is morphed, owned by the caller and kept alive until replaced
+    void setMorphLadders(const MorphLadders* newLadders) noexcept;
+
+    //Shifts the notes of every lane, notes already held are released with the number they started with
+    void setTranspose(int semitones) noexcept { transpose = semitones; }
+
+    //While closed pulses play as rests, held notes still get their full gate
+    void setGateOpen(bool shouldBeOpen) noexcept { gateOpen = shouldBeOpen; }
+
+    //Every lane starts again from its first step at the start of the next processed block
+    void retrigger() noexcept { retriggerPending = true; }
+
+    //Copies every lane of the snapshot into the engine, lanes past its numLanes are disabled
+    void applySnapshot(const LaneSnapshot& snapshot) noexcept;
+
+    //As above but only the lanes, the seed, groove and morph length stay as they are
+    void applyLaneConfigs(const LaneSnapshot& snapshot) noexcept;
+
+    bool isLaneEnabled(int lane) const noexcept { return ((enabledLanes >> lane) & 1u) != 0; }
+
+    //==============================================================================
+    struct Event
+    {
+        enum Type
+        {
+            noteOn,
+            noteOff,
+            rest
+        };
+
+        Type type;
+        int lane;
+        int noteNumber;
+        int stepIndex;      //-1 for note offs
+        int sampleOffset;
+        int velocity = 0;   //Only set for note ons
+    };
+
+    //Where the host transport is at the start of a block
+    struct Transport
+    {
+        double ppqPosition = 0.0;
+        double bpm = 120.0;
+        bool isLooping = false;
+        double loopStartPpq = 0.0;
+        double loopEndPpq = 0.0;
+
+        //Length of a bar in quarter notes, from the host's time signature
+        double quartersPerBar = 4.0;
+    };
+
+    //Calls callback(const Event&) for every step and note release in the block, grouped by lane.
+    //A release always comes before a note on of the same lane at the same sample.
+    //Returns the mask of lanes that had a step
+    template <typename Callback>
+    uint64_t process(double ppqPosition, double bpm, int numSamples, Callback&& callback) noexcept
+    {
+        Transport transport;
+        transport.ppqPosition = ppqPosition;
+        transport.bpm = bpm;
+        return process(transport, numSamples, callback);
+    }
+
+    //As above, and a loop wrap inside the block restarts every lane from the loop start at the sample it happens on
+    template <typename Callback>
+    uint64_t process(const Transport& transport, int numSamples, Callback&& callback) noexcept
+    {
+        if (! beginBlock(transport, numSamples, callback))
+            return 0;
+
+        auto steppedLanes = processUntil(numSamples, callback);
+        endBlock(callback);
+        return steppedLanes;
+    }
+
+    //The same in pieces, for a caller that changes lanes part way through a block. The block's position and
+    //tempo are taken once, every piece carries on from where the previous one ended on the same tempo ramp.
+    //Event sample offsets are relative to the start of the block. Returns false if there is nothing to schedule
+    template <typename Callback>
+    bool beginBlock(const Transport& transport, int numSamples, Callback&& callback) noexcept
+    {
+        isInBlock = scheduler.beginBlock(transport.ppqPosition, transport.bpm, numSamples);
+
+        if (! isInBlock)
+            return false;
+
+        blockTransport = transport;
+        blockSize = numSamples;
+        processedSamples = 0;
+
+        //Nothing that was held before a jump belongs to the new position, a small drift leaves the lanes where they are
+        if (scheduler.hasJumped() || releaseAllPending)
+        {
+            releaseAll(callback);
+            unsyncedLanes = ~uint64_t(0);
+        }
+
+        return true;
+    }
+
+    //Emits everything up to endSample of the block, returns the mask of lanes that had a step
+    template <typename Callback>
+    uint64_t processUntil(int endSample, Callback&& callback) noexcept
+    {
+        endSample = endSample > blockSize ? blockSize : endSample;
+
+        if (! isInBlock || endSample <= processedSamples)
+            return 0;
+
+        if (processedSamples > 0)
+            scheduler.continueSegment();
+
+        if (retriggerPending)
+        {
+            phaseOriginPpq = scheduler.getWindowStartPpq();
+            unsyncedLanes = ~uint64_t(0);
+            retriggerPending = false;
+        }
+
+        uint64_t steppedLanes = 0;
+
+        for (int numWraps = 0;; ++numWraps)
+        {
+            scheduler.limitSegmentTo(endSample);
+
+            auto wraps = numWraps < maxLoopWrapsPerBlock && isLoopWrapInSegment(blockTransport);
+            auto wrapSample = wraps ? scheduler.endSegmentAt(blockTransport.loopEndPpq) : endSample;
+
+            syncLanes(unsyncedLanes & enabledLanes);
+            steppedLanes |= emitSteps(callback);
+
+            if (! wraps)
+                break;
+
+            //Carry the part of a sample that went past the loop end over to the loop start
+            auto overshootPpq = scheduler.getPpqAt(wrapSample) - blockTransport.loopEndPpq;
+            scheduler.startSegment(wrapSample, blockTransport.loopStartPpq + overshootPpq);
+
+            //Held notes play out their gate, the lanes start again from the loop start
+            unsyncedLanes = ~uint64_t(0);
+        }
+
+        //Releases due in this piece that no new note cut short
+        emitReleasesBefore(blockStartSample + endSample, callback);
+
+        processedSamples = endSample;
+        return steppedLanes;
+    }
+
+    //Emits whatever of the block is left
+    template <typename Callback>
+    void endBlock(Callback&& callback) noexcept
+    {
+        if (! isInBlock)
+            return;
+
+        processUntil(blockSize, callback);
+
+        blockStartSample += blockSize;
+        isInBlock = false;
+    }
+
+    //Unrounded sample offset at which the transport has moved deltaPpq on from the start of the block, following
+    //a tempo ramp. Only valid between beginBlock() and endBlock()
+    double getBlockSampleOffset(double deltaPpq) const noexcept { return scheduler.getBlockSampleOffset(deltaPpq); }
+
+    //Call when the transport stops, held notes are released at the start of the block.
+    //Lanes find their place again when it restarts
+    template <typename Callback>
+    void stop(Callback&& callback) noexcept
+    {
+        releaseAll(callback);
+        scheduler.stop();
+        phaseOriginPpq = 0.0;
+    }
+
+    //Held notes are released at the start of the next processed block
+    void requestReleaseAll() noexcept { releaseAllPending = true; }
+
+    int getNumHeldNotes() const noexcept { return releases.getNumPending(); }
+
+    StepScheduler::JitterReport getJitterReport() const noexcept { return scheduler.getJitterReport(); }
+
+private:
+    //Puts the lanes in the mask on the first step at or after the start of the block
+    void syncLanes(uint64_t lanes) noexcept;
+
+    //Mask of enabled lanes whose next step is before windowEndPpq
+    uint64_t findDueLanes(double windowEndPpq) const noexcept;
+
+    static int findLowestLane(uint64_t lanes) noexcept;
+
+    int getStepVelocity(int lane, int stepIndex) const noexcept;
+
+    //Marks whether the lane's ladder was built between the patterns the lane has now
+    void updateLadderMatch(int lane) noexcept;
+
+    //The lane's pattern, or the ladder level closest to where its morph is
+    const StepPattern& getPlayingPattern(int lane) const noexcept
+    {
+        auto level = static_cast<int>(morphPosition[lane] * (MorphLadder::numLevels - 1) + 0.5);
+
+        if (level <= 0 || ((matchingLadders >> lane) & 1u) == 0)
+            return patterns[lane];
+
+        return morphLadders->lanes[lane].levels[level];
+    }
+
+    void advanceMorph(int lane) noexcept
+    {
+        auto& position = morphPosition[lane];
+        auto target = morphTarget[lane];
+
+        if (position == target)
+            return;
+
+        auto morphLengthPpq = morphLengthBars * blockTransport.quartersPerBar;
+        auto delta = morphLengthPpq > 0.0 ? stepLengthPpq[lane] / morphLengthPpq : 1.0;
+        position = position < target ? (position + delta < target ? position + delta : target)
+                                     : (position - delta > target ? position - delta : target);
+    }
+
+    int getPlayingNote(int lane) const noexcept
+    {
+        auto noteNumber = notes[lane] + transpose;
+        return noteNumber < 0 ? 0 : (noteNumber > 127 ? 127 : noteNumber);
+    }
+
+    //Grooved position of a lane's absolute step
+    double getStepPpq(int lane, int64_t step) const noexcept
+    {
+        return phaseOriginPpq + (static_cast<double>(step) + groove.timing[groove.getIndex(step)]) * stepLengthPpq[lane];
+    }
+
+    int getGroovedVelocity(int lane, int stepIndex, int64_t step) const noexcept
+    {
+        auto velocity = static_cast<int>(getStepVelocity(lane, stepIndex) * groove.velocity[groove.getIndex(step)] + 0.5);
+        return velocity < 1 ? 1 : (velocity > 127 ? 127 : velocity);
+    }
+
+    //Loops shorter than a sample are ignored, and very short ones stop wrapping after this many per block
+    static constexpr int maxLoopWrapsPerBlock = 64;
+
+    bool isLoopWrapInSegment(const Transport& transport) const noexcept
+    {
+        if (! transport.isLooping || (transport.loopEndPpq - transport.loopStartPpq) * scheduler.getSamplesPerPpq() < 1.0)
+            return false;
+
+        return scheduler.getWindowStartPpq() < transport.loopEndPpq && transport.loopEndPpq < scheduler.getWindowEndPpq();
+    }
+
+    //Emits the steps of every lane due in the current segment, returns the mask of lanes that had one
+    template <typename Callback>
+    uint64_t emitSteps(Callback& callback) noexcept
+    {
+        auto windowEndPpq = scheduler.getWindowEndPpq();
+        auto dueLanes = findDueLanes(windowEndPpq);
+        auto steppedLanes = dueLanes;
+
+        while (dueLanes != 0)
+        {
+            auto lane = findLowestLane(dueLanes);
+            dueLanes &= dueLanes - 1;
+
+            while (nextStepPpq[lane] < windowEndPpq)
+            {
+                const auto& pattern = getPlayingPattern(lane);
+                auto length = pattern.getLength();
+                auto stepIndex = length > 0 ? static_cast<int>(nextStep[lane] % length) : 0;
+
+                if (stepIndex < 0)
+                    stepIndex += length;
+
+                auto sampleOffset = scheduler.getSampleOffset(nextStepPpq[lane]);
+
+                //Drawn on every step, so editing the pattern doesn't shift the choices of later steps
+                auto chance = random[lane].next();
+
+                auto noteNumber = getPlayingNote(lane);
+
+                if (gateOpen && pattern.isPulse(stepIndex) && chance < probabilityThreshold[lane])
+                {
+                    //A note still held by this lane is cut by the new one, or released on time if it ended earlier
+                    NoteReleaseQueue<maxLanes>::Release held;
+
+                    if (releases.removeLane(lane, held))
+                    {
+                        auto releaseOffset = static_cast<int>(held.sampleTime - blockStartSample);
+                        callback(Event { Event::noteOff, lane, held.noteNumber, -1, releaseOffset < sampleOffset ? releaseOffset : sampleOffset });
+                    }
+
+                    callback(Event { Event::noteOn, lane, noteNumber, stepIndex, sampleOffset, getGroovedVelocity(lane, stepIndex, nextStep[lane]) });
+
+                    auto gateSamples = static_cast<int64_t>(gateLength[lane] * stepLengthPpq[lane] * scheduler.getSamplesPerPpq());
+                    releases.push({ blockStartSample + sampleOffset + (gateSamples > 1 ? gateSamples : 1), lane, noteNumber });
+                }
+                else
+                {
+                    callback(Event { Event::rest, lane, noteNumber, stepIndex, sampleOffset });
+                }
+
+                advanceMorph(lane);
+
+                ++nextStep[lane];
+                nextStepPpq[lane] = getStepPpq(lane, nextStep[lane]);
+            }
+        }
+
+        return steppedLanes;
+    }
+
+    template <typename Callback>
+    void emitReleasesBefore(int64_t sampleTime, Callback& callback) noexcept
+    {
+        while (! releases.isEmpty() && releases.top().sampleTime < sampleTime)
+        {
+            const auto& release = releases.top();
+            callback(Event { Event::noteOff, release.lane, release.noteNumber, -1, static_cast<int>(release.sampleTime - blockStartSample) });
+            releases.pop();
+        }
+    }
+
+    template <typename Callback>
+    void releaseAll(Callback& callback) noexcept
+    {
+        while (! releases.isEmpty())
+        {
+            const auto& release = releases.top();
+            callback(Event { Event::noteOff, release.lane, release.noteNumber, -1, 0 });
+            releases.pop();
+        }
+
+        releaseAllPending = false;
+    }
+
+    StepScheduler scheduler;
+
+    int numLanes = 0;
+    uint64_t enabledLanes = 0;
+    uint64_t unsyncedLanes = ~uint64_t(0);
+
+    alignas(16) double nextStepPpq[maxLanes];
+    double stepLengthPpq[maxLanes];
+    int64_t nextStep[maxLanes];
+    double gateLength[maxLanes];
+    int notes[maxLanes];
+    StepPattern patterns[maxLanes];
+
+    LaneRandom random[maxLanes];
+    uint64_t probabilityThreshold[maxLanes];
+    int velocities[maxLanes];
+    double accents[maxLanes];
+    uint64_t randomSeed = 0;
+
+    //Steps delayed past the end of a block simply stay due until the block they land in
+    GrooveTable groove;
+
+    //Morph positions move towards their targets by one step's share of the morph length per step
+    double morphPosition[maxLanes];
+    double morphTarget[maxLanes];
+    double morphLengthBars = 0.0;
+    StepPattern morphTargetPatterns[maxLanes];
+    const MorphLadders* morphLadders = nullptr;
+    uint64_t matchingLadders = 0;
+
+    //Driven by MIDI input, step 0 of every lane falls on phaseOriginPpq
+    int transpose = 0;
+    bool gateOpen = true;
+    bool retriggerPending = false;
+    double phaseOriginPpq = 0.0;
+
+    //Samples processed while playing, releases are keyed on this
+    int64_t blockStartSample = 0;
+
+    //The block being processed in pieces
+    Transport blockTransport;
+    int blockSize = 0;
+    int processedSamples = 0;
+    bool isInBlock = false;
+    NoteReleaseQueue<maxLanes> releases;
+    bool releaseAllPending = false;
+};
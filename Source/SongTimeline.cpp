@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    SongTimeline.cpp
+
+  ==============================================================================
+*/
+
+#include "SongTimeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+SongTimeline::SongTimeline(const std::vector<SongSection>& sections, const std::function<const LaneSnapshot*(int)>& getProgramSnapshot)
+{
+    entries.reserve(sections.size());
+
+    for (const auto& section : sections)
+    {
+        auto* snapshot = getProgramSnapshot(section.program);
+        auto numBars = section.bars * section.repeats;
+
+        if (snapshot == nullptr || numBars <= 0)
+            continue;
+
+        //Back to back sections of the same program are one entry
+        if (entries.empty() || entries.back().snapshot != snapshot)
+            entries.push_back({ lengthInBars, snapshot });
+
+        lengthInBars += numBars;
+    }
+}
+
+double SongTimeline::getEntryEndBar(int index) const noexcept
+{
+    return index + 1 < getNumEntries() ? entries[static_cast<size_t>(index + 1)].startBar : lengthInBars;
+}
+
+double SongTimeline::wrapBar(double bar) const noexcept
+{
+    if (lengthInBars <= 0.0)
+        return 0.0;
+
+    auto wrapped = std::fmod(bar, lengthInBars);
+    return wrapped < 0.0 ? wrapped + lengthInBars : wrapped;
+}
+
+bool SongTimeline::contains(int index, double wrappedBar) const noexcept
+{
+    return index >= 0 && index < getNumEntries()
+        && entries[static_cast<size_t>(index)].startBar <= wrappedBar && wrappedBar < getEntryEndBar(index);
+}
+
+int SongTimeline::findEntry(double wrappedBar) const noexcept
+{
+    auto next = std::upper_bound(entries.begin(), entries.end(), wrappedBar,
+                                 [](double bar, const Entry& entry) { return bar < entry.startBar; });
+
+    return next == entries.begin() ? 0 : static_cast<int>(next - entries.begin()) - 1;
+}
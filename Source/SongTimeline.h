@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    SongTimeline.h
+
+    A chain of programs switching at bar boundaries, compiled into a table.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "LaneSnapshot.h"
+
+//==============================================================================
+//One part of a song, a program played for a number of bars, repeated
+struct SongSection
+{
+    int program = 0;
+    int bars = 1;
+    int repeats = 1;
+};
+
+//==============================================================================
+/**
+    The sections of a song flattened into entries sorted by the bar they start
+    on, each pointing at the prebuilt snapshot of its program. The song loops,
+    so any position maps to exactly one entry.
+
+    Compiling happens on the message thread whenever the arrangement changes.
+    The audio thread only searches the table when the playhead leaves the
+    current entry, and otherwise just counts down to the next boundary.
+*/
+class SongTimeline
+{
+public:
+    struct Entry
+    {
+        double startBar;
+        const LaneSnapshot* snapshot;
+    };
+
+    //Sections whose program has no snapshot or that last no bars are left out
+    SongTimeline(const std::vector<SongSection>& sections, const std::function<const LaneSnapshot*(int)>& getProgramSnapshot);
+
+    bool isEmpty() const noexcept { return entries.empty(); }
+    int getNumEntries() const noexcept { return static_cast<int>(entries.size()); }
+    double getLengthInBars() const noexcept { return lengthInBars; }
+
+    const Entry& getEntry(int index) const noexcept { return entries[static_cast<size_t>(index)]; }
+    double getEntryEndBar(int index) const noexcept;
+
+    //Maps a position into the first pass of the song
+    double wrapBar(double bar) const noexcept;
+
+    bool contains(int index, double wrappedBar) const noexcept;
+
+    //Binary search for the entry playing at a wrapped bar position
+    int findEntry(double wrappedBar) const noexcept;
+
+private:
+    std::vector<Entry> entries;
+    double lengthInBars = 0.0;
+};
@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    StateSerializer.cpp
+
+  ==============================================================================
+*/
+
+#include "StateSerializer.h"
+
+void StateSerializer::submit(std::unique_ptr<PluginStateFormat::Snapshot> snapshot, uint32 capturedAtChange)
+{
+    const ScopedLock sl(pendingLock);
+    pending = std::move(snapshot);
+    pendingChange = capturedAtChange;
+}
+
+bool StateSerializer::copyLatest(MemoryBlock& destData) const
+{
+    std::shared_ptr<const Serialised> serialised;
+
+    {
+        const SpinLock::ScopedLockType sl(latestLock);
+        serialised = latest;
+    }
+
+    if (serialised == nullptr || serialised->change != changeCount.load())
+        return false;
+
+    destData.replaceAll(serialised->data.getData(), serialised->data.getSize());
+    return true;
+}
+
+int StateSerializer::useTimeSlice()
+{
+    std::unique_ptr<PluginStateFormat::Snapshot> snapshot;
+    uint32 change;
+
+    {
+        const ScopedLock sl(pendingLock);
+        snapshot = std::move(pending);
+        change = pendingChange;
+    }
+
+    if (snapshot == nullptr)
+        return 50;
+
+    auto serialised = std::make_shared<Serialised>();
+    serialised->change = change;
+    PluginStateFormat::write(*snapshot, serialised->data);
+
+    //The replaced data is freed outside the lock, unless a reader still holds it
+    std::shared_ptr<const Serialised> previous = std::move(serialised);
+
+    {
+        const SpinLock::ScopedLockType sl(latestLock);
+        std::swap(latest, previous);
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    StateSerializer.h
+
+    Turns state snapshots into session data on a background thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "PluginStateFormat.h"
+
+//==============================================================================
+/**
+    Keeps the serialised state ready for the host to pick up.
+
+    Every change to the state bumps a change count. The processor captures a
+    snapshot on the message thread soon after, and this writes it out on a
+    background thread, tagged with the count it was captured at. Saving then
+    only copies the finished data, and falls back to serialising in place if
+    the state changed since, so the host never gets an older or half written
+    state.
+*/
+class StateSerializer : public TimeSliceClient
+{
+public:
+    StateSerializer() = default;
+
+    //Any thread, including the audio thread
+    void markChanged() noexcept { ++changeCount; }
+    uint32 getChangeCount() const noexcept { return changeCount.load(); }
+
+    //Message thread, replaces a snapshot still waiting to be written
+    void submit(std::unique_ptr<PluginStateFormat::Snapshot> snapshot, uint32 capturedAtChange);
+
+    //Copies the serialised state if it is up to date, otherwise returns false and leaves destData alone
+    bool copyLatest(MemoryBlock& destData) const;
+
+    int useTimeSlice() override;
+
+private:
+    std::atomic<uint32> changeCount { 1 };
+
+    CriticalSection pendingLock;
+    std::unique_ptr<PluginStateFormat::Snapshot> pending;
+    uint32 pendingChange = 0;
+
+    //Replaced as a whole, so a reader copying the data holds on to the one it started with
+    struct Serialised
+    {
+        MemoryBlock data;
+        uint32 change = 0;
+    };
+
+    SpinLock latestLock;
+    std::shared_ptr<const Serialised> latest;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StateSerializer)
+};
@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    StepPattern.cpp
+
+  ==============================================================================
+*/
+
+#include "StepPattern.h"
+
+#include "EuclideanPatterns.h"
+
+namespace
+{
+    //A sequence in the Euclidean pairing, kept as bits plus a length
+    struct Sequence
+    {
+        uint64_t bits[StepPattern::maxSteps / 64] = {};
+        int length = 0;
+
+        void append(const Sequence& other) noexcept
+        {
+            for (int i = 0; i < other.length && length < StepPattern::maxSteps; ++i, ++length)
+                if ((other.bits[i >> 6] >> (i & 63)) & 1u)
+                    bits[length >> 6] |= uint64_t(1) << (length & 63);
+        }
+    };
+}
+
+StepPattern StepPattern::euclidean(int pulses, int steps) noexcept
+{
+    if (steps > maxSteps)
+        steps = maxSteps;
+
+    if (steps <= 0)
+        return {};
+
+    if (steps <= EuclideanPatterns::maxSteps)
+        return fromMask(EuclideanPatterns::get(pulses, steps), steps);
+
+    //We can only have as many beats as we have steps (0 <= beats <= steps)
+    if (pulses > steps)
+        pulses = steps;
+
+    if (pulses < 0)
+        pulses = 0;
+
+    //Same pairing as EuclideanPatterns::generate, on sequences long enough for 256 steps
+    Sequence x;
+    x.bits[0] = 1;
+    x.length = 1;
+    int x_amount = pulses;
+
+    Sequence y;
+    y.length = 1;
+    int y_amount = steps - pulses;
+
+    do
+    {
+        int x_temp = x_amount;
+        int y_temp = y_amount;
+        Sequence y_copy = y;
+
+        //Check which is the dominant pair
+        if (x_temp >= y_temp)
+        {
+            x_amount = y_temp;
+            y_amount = x_temp - y_temp;
+
+            //The previous dominant pair becomes the new non dominant pair
+            y = x;
+        }
+        else
+        {
+            x_amount = x_temp;
+            y_amount = y_temp - x_temp;
+        }
+
+        //Create the new dominant pair by combining the previous pairs
+        x.append(y_copy);
+    } while (x_amount > 1 && y_amount > 1);
+
+    Sequence rhythm;
+    for (int i = 1; i <= x_amount; i++)
+        rhythm.append(x);
+    for (int i = 1; i <= y_amount; i++)
+        rhythm.append(y);
+
+    StepPattern pattern;
+    pattern.length = steps;
+
+    for (int i = 0; i < steps; ++i)
+        pattern.setStep(i, ((rhythm.bits[i >> 6] >> (i & 63)) & 1u) != 0);
+
+    return pattern;
+}
+
+StepPattern StepPattern::fromMask(uint64_t mask, int numSteps) noexcept
+{
+    StepPattern pattern;
+    pattern.length = numSteps < 0 ? 0 : (numSteps > 64 ? 64 : numSteps);
+
+    for (int i = 0; i < pattern.length; ++i)
+        pattern.setStep(i, ((mask >> i) & 1u) != 0);
+
+    return pattern;
+}
+
+StepPattern StepPattern::rests(int numSteps) noexcept
+{
+    StepPattern pattern;
+    pattern.length = numSteps < 0 ? 0 : (numSteps > maxSteps ? maxSteps : numSteps);
+    return pattern;
+}
+
+void StepPattern::setStep(int stepIndex, bool isPulse) noexcept
+{
+    if (stepIndex < 0 || stepIndex >= length)
+        return;
+
+    //Write both copies so rotated reads stay valid
+    writeBit(stepIndex, isPulse);
+    writeBit(stepIndex + length, isPulse);
+}
+
+void StepPattern::writeBit(int index, bool isPulse) noexcept
+{
+    auto bit = uint64_t(1) << (index & 63);
+
+    if (isPulse)
+        bits[index >> 6] |= bit;
+    else
+        bits[index >> 6] &= ~bit;
+}
+
+void StepPattern::setRotation(int numSteps) noexcept
+{
+    if (length <= 0)
+    {
+        rotation = 0;
+        return;
+    }
+
+    rotation = numSteps % length;
+
+    if (rotation < 0)
+        rotation += length;
+}
+
+int StepPattern::countPulses() const noexcept
+{
+    int count = 0;
+
+    for (int i = 0; i < length; ++i)
+        if (isPulse(i))
+            ++count;
+
+    return count;
+}
+
+bool StepPattern::operator==(const StepPattern& other) const noexcept
+{
+    if (length != other.length || rotation != other.rotation || invertMask != other.invertMask)
+        return false;
+
+    for (int i = 0; i < numWords; ++i)
+        if (bits[i] != other.bits[i])
+            return false;
+
+    return true;
+}
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    StepPattern.h
+
+    Fixed size bitset holding one rhythm of up to 256 steps.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/**
+    A rhythm stored as bits, bit n set when step n is a pulse.
+
+    The steps are stored twice back to back, so a rotated step is read straight
+    from the second copy without wrapping. Rotation and inversion are only an
+    offset and a flag, changing them never touches the bits.
+*/
+class StepPattern
+{
+public:
+    static constexpr int maxSteps = 256;
+
+    StepPattern() noexcept = default;
+
+    //Euclidean rhythm, patterns up to 32 steps come from the EuclideanPatterns table
+    static StepPattern euclidean(int pulses, int steps) noexcept;
+
+    //Builds a pattern from the low numSteps bits of a mask
+    static StepPattern fromMask(uint64_t mask, int numSteps) noexcept;
+
+    //numSteps rests, for generators that set their pulses one by one
+    static StepPattern rests(int numSteps) noexcept;
+
+    void setStep(int stepIndex, bool isPulse) noexcept;
+
+    int getLength() const noexcept { return length; }
+
+    //Shifts the pattern so step 0 plays what used to be step numSteps
+    void setRotation(int numSteps) noexcept;
+    int getRotation() const noexcept { return rotation; }
+
+    //Swaps pulses and rests
+    void setInverted(bool shouldBeInverted) noexcept { invertMask = shouldBeInverted ? 1u : 0u; }
+    bool isInverted() const noexcept { return invertMask != 0; }
+
+    //stepIndex must be in 0..getLength()-1
+    bool isPulse(int stepIndex) const noexcept
+    {
+        auto index = static_cast<unsigned int>(stepIndex + rotation);
+        return (((bits[index >> 6] >> (index & 63u)) & 1u) ^ invertMask) != 0;
+    }
+
+    int countPulses() const noexcept;
+
+    bool operator==(const StepPattern& other) const noexcept;
+    bool operator!=(const StepPattern& other) const noexcept { return ! operator==(other); }
+
+private:
+    static constexpr int numWords = (2 * maxSteps) / 64;
+
+    void writeBit(int index, bool isPulse) noexcept;
+
+    uint64_t bits[numWords] = {};
+    int length = 0;
+    int rotation = 0;
+    uint64_t invertMask = 0;
+};
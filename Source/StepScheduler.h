@@ -0,0 +1,285 @@
+/*
+  ==============================================================================
+
+    StepScheduler.h
+
+    Finds the exact sample offset of every step boundary inside a block.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+//==============================================================================
+/**
+    Works out where step boundaries fall in a block from the host's ppq position
+    and tempo, so any number of steps per block are emitted at the sample they
+    belong to.
+
+    A block owns the boundaries from half a sample before its first sample up to
+    half a sample before its end, which keeps consecutive blocks from emitting
+    a boundary twice or dropping it. The rounding error of every emitted step is
+    collected into a jitter report that can be read from any thread.
+
+    Positions inside the block are integrated from the tempo, and a tempo that
+    changed by the same amount over the last two blocks is carried on as a ramp
+    through this one. A block can be split into segments, so a loop wrap
+    restarts the mapping from the loop start at the sample it happens on. A
+    segment can also be cut short and continued from the same position, for
+    a caller that changes the lanes part way through a block.
+
+    The scheduler only knows about the block, the lane phases live in the
+    RhythmEngine so they can be kept in contiguous arrays.
+*/
+class StepScheduler
+{
+public:
+    struct JitterReport
+    {
+        double maxSamples = 0.0;
+        double meanSamples = 0.0;
+        int64_t numSteps = 0;
+    };
+
+    //How a block's position relates to where the previous block ended
+    enum class Continuity
+    {
+        continuous,     //Within half a sample of the expected position
+        drifted,        //Off by less than maxDriftSeconds, lanes carry on where they are
+        jumped          //A seek, a restart or the first block, lanes have to find their place again
+    };
+
+    void prepare(double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        hasPreviousBlock = false;
+        continuity = Continuity::jumped;
+        measuredSlope = 0.0;
+        resetJitterReport();
+    }
+
+    //Sets up the window for this block, returns false if there is nothing to schedule
+    bool beginBlock(double ppqPosition, double bpm, int numSamples) noexcept
+    {
+        if (bpm <= 0.0 || sampleRate <= 0.0 || numSamples <= 0)
+        {
+            hasPreviousBlock = false;
+            return false;
+        }
+
+        tempoSlope = 0.0;
+
+        if (hasPreviousBlock)
+        {
+            auto errorSamples = std::abs(ppqPosition - expectedPpq) * sampleRate * 60.0 / bpm;
+
+            if (errorSamples <= 0.5)
+                continuity = Continuity::continuous;
+            else if (errorSamples <= maxDriftSeconds * sampleRate)
+                continuity = Continuity::drifted;
+            else
+                continuity = Continuity::jumped;
+
+            //A host reports the tempo at the start of each block, a ramp shows up as the same change block after block
+            auto newSlope = (bpm - previousBpm) / previousBlockSize;
+
+            if (continuity != Continuity::jumped && newSlope != 0.0
+                && std::abs(newSlope - measuredSlope) <= maxRampDeviation * std::abs(newSlope)
+                && bpm + newSlope * numSamples > 0.0)
+                tempoSlope = newSlope;
+
+            measuredSlope = newSlope;
+        }
+        else
+        {
+            continuity = Continuity::jumped;
+            measuredSlope = 0.0;
+        }
+
+        blockSize = numSamples;
+        blockStartBpm = bpm;
+        previousBpm = bpm;
+        previousBlockSize = numSamples;
+        hasPreviousBlock = true;
+
+        startSegment(0, ppqPosition);
+        return true;
+    }
+
+    //Restarts the position at firstSample of the block, for a loop wrap. The segment runs to the end of the block
+    void startSegment(int firstSample, double ppqPosition) noexcept
+    {
+        segmentStart = firstSample;
+        segmentEnd = blockSize;
+        segmentStartPpq = ppqPosition;
+
+        ppqPerSample = (blockStartBpm + tempoSlope * firstSample) / (60.0 * sampleRate);
+        ppqPerSampleSlope = tempoSlope / (60.0 * sampleRate);
+
+        windowStartPpq = getPpqAt(segmentStart - 0.5);
+        windowEndPpq = getPpqAt(segmentEnd - 0.5);
+
+        expectedPpq = getPpqAt(blockSize);
+    }
+
+    //Ends the current segment where it reaches endPpq, returns the sample the next segment starts at
+    int endSegmentAt(double endPpq) noexcept
+    {
+        auto endSample = static_cast<int>(std::lround(getExactSampleOffset(endPpq)));
+
+        segmentEnd = endSample < segmentStart ? segmentStart : (endSample > segmentEnd ? segmentEnd : endSample);
+        windowEndPpq = endPpq;
+        return segmentEnd;
+    }
+
+    //Ends the current segment at a sample of the block if it would run past it, the window shrinks to match
+    void limitSegmentTo(int endSample) noexcept
+    {
+        if (endSample >= segmentEnd)
+            return;
+
+        segmentEnd = endSample < segmentStart ? segmentStart : endSample;
+        windowEndPpq = getPpqAt(segmentEnd - 0.5);
+    }
+
+    //Starts the next segment where the current one ended, on the same tempo ramp. The segment runs to the end of the block
+    void continueSegment() noexcept
+    {
+        auto previousWindowEndPpq = windowEndPpq;
+        startSegment(segmentEnd, getPpqAt(segmentEnd));
+
+        //Taken over exactly, so a boundary on the cut belongs to one segment only
+        windowStartPpq = previousWindowEndPpq;
+    }
+
+    //Call when the transport stops, the next block starts a new timeline
+    void stop() noexcept { hasPreviousBlock = false; }
+
+    Continuity getContinuity() const noexcept { return continuity; }
+
+    //True if the playhead doesn't continue from the previous block, lanes then have to find their place again
+    bool hasJumped() const noexcept { return continuity == Continuity::jumped; }
+
+    //At the start of the current segment
+    double getSamplesPerPpq() const noexcept { return 1.0 / ppqPerSample; }
+
+    //Boundaries in [windowStart, windowEnd) belong to the current segment
+    double getWindowStartPpq() const noexcept { return windowStartPpq; }
+    double getWindowEndPpq() const noexcept { return windowEndPpq; }
+
+    //Position at a sample offset of the block, only valid inside the current segment
+    double getPpqAt(double sampleOffset) const noexcept
+    {
+        auto t = sampleOffset - segmentStart;
+        return segmentStartPpq + t * (ppqPerSample + 0.5 * ppqPerSampleSlope * t);
+    }
+
+    //Unrounded sample offset of the block at which the current segment reaches ppqPosition
+    double getExactSampleOffset(double ppqPosition) const noexcept
+    {
+        //Solves ppq(t) = ppqPosition for the integrated ramp, in the form that stays stable for a constant tempo
+        auto delta = ppqPosition - segmentStartPpq;
+        auto discriminant = ppqPerSample * ppqPerSample + 2.0 * ppqPerSampleSlope * delta;
+
+        if (discriminant <= 0.0)
+            return static_cast<double>(blockSize);
+
+        return segmentStart + 2.0 * delta / (ppqPerSample + std::sqrt(discriminant));
+    }
+
+    //Unrounded sample offset at which the transport has moved deltaPpq on from the start of the block, loop wraps aside
+    double getBlockSampleOffset(double deltaPpq) const noexcept
+    {
+        auto startPpqPerSample = blockStartBpm / (60.0 * sampleRate);
+        auto discriminant = startPpqPerSample * startPpqPerSample + 2.0 * ppqPerSampleSlope * deltaPpq;
+
+        if (discriminant <= 0.0)
+            return static_cast<double>(blockSize);
+
+        return 2.0 * deltaPpq / (startPpqPerSample + std::sqrt(discriminant));
+    }
+
+    //First step of the given length, counted from originPpq, that falls inside or after the current segment
+    int64_t getFirstStepInWindow(double stepLengthPpq, double originPpq = 0.0) const noexcept
+    {
+        return static_cast<int64_t>(std::ceil((windowStartPpq - originPpq) / stepLengthPpq));
+    }
+
+    //Sample offset of a boundary inside the window, the rounding error goes into the jitter report
+    int getSampleOffset(double boundaryPpq) noexcept
+    {
+        auto exactOffset = getExactSampleOffset(boundaryPpq);
+        auto sampleOffset = static_cast<int>(std::lround(exactOffset));
+
+        if (sampleOffset < segmentStart)
+            sampleOffset = segmentStart;
+        else if (sampleOffset >= segmentEnd)
+            sampleOffset = segmentEnd > segmentStart ? segmentEnd - 1 : segmentStart;
+
+        addJitter(std::abs(sampleOffset - exactOffset));
+        return sampleOffset;
+    }
+
+    JitterReport getJitterReport() const noexcept
+    {
+        JitterReport report;
+        report.numSteps = jitterCount.load();
+        report.maxSamples = jitterMax.load();
+        report.meanSamples = report.numSteps > 0 ? jitterTotal.load() / static_cast<double>(report.numSteps) : 0.0;
+        return report;
+    }
+
+    void resetJitterReport() noexcept
+    {
+        jitterMax = 0.0;
+        jitterTotal = 0.0;
+        jitterCount = 0;
+    }
+
+private:
+    //Only the audio thread writes, so plain load/store is enough
+    void addJitter(double samples) noexcept
+    {
+        if (samples > jitterMax.load())
+            jitterMax = samples;
+
+        jitterTotal = jitterTotal.load() + samples;
+        jitterCount = jitterCount.load() + 1;
+    }
+
+    //Bigger position errors are treated as a seek
+    static constexpr double maxDriftSeconds = 0.005;
+
+    //How much two consecutive tempo changes may differ and still count as one ramp
+    static constexpr double maxRampDeviation = 0.25;
+
+    double sampleRate = 44100.0;
+    int blockSize = 0;
+    double blockStartBpm = 120.0;
+
+    //bpm per sample, only set while a ramp is detected
+    double tempoSlope = 0.0;
+    double measuredSlope = 0.0;
+    double previousBpm = 0.0;
+    int previousBlockSize = 1;
+
+    int segmentStart = 0;
+    int segmentEnd = 0;
+    double segmentStartPpq = 0.0;
+    double ppqPerSample = 0.0;
+    double ppqPerSampleSlope = 0.0;
+
+    double windowStartPpq = 0.0;
+    double windowEndPpq = 0.0;
+    double expectedPpq = 0.0;
+    bool hasPreviousBlock = false;
+    Continuity continuity = Continuity::jumped;
+
+    std::atomic<double> jitterMax { 0.0 };
+    std::atomic<double> jitterTotal { 0.0 };
+    std::atomic<int64_t> jitterCount { 0 };
+};
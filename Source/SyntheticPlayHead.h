@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    SyntheticPlayHead.h
+
+    Playhead with a scripted transport, for driving the processor without a host.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Reports a constant tempo transport at whatever sample position it was last
+    moved to. The ppq position is derived from the sample position, just like
+    a host would with a fixed tempo.
+*/
+class SyntheticPlayHead : public AudioPlayHead
+{
+public:
+    SyntheticPlayHead()
+    {
+        info.resetToDefault();
+        info.bpm = 120.0;
+        info.isPlaying = true;
+    }
+
+    void setSampleRate(double newSampleRate) noexcept  { sampleRate = newSampleRate; updatePosition(); }
+    void setTempo(double newBpm) noexcept              { info.bpm = newBpm; updatePosition(); }
+    void setPlaying(bool shouldBePlaying) noexcept     { info.isPlaying = shouldBePlaying; }
+
+    void setTimeSignature(int numerator, int denominator) noexcept
+    {
+        info.timeSigNumerator = numerator;
+        info.timeSigDenominator = denominator;
+        updatePosition();
+    }
+
+    void setPositionInSamples(int64 newTimeInSamples) noexcept
+    {
+        info.timeInSamples = newTimeInSamples;
+        updatePosition();
+    }
+
+    double getSamplesPerQuarterNote() const noexcept { return sampleRate * 60.0 / info.bpm; }
+
+    bool getCurrentPosition(CurrentPositionInfo& result) override
+    {
+        result = info;
+        return true;
+    }
+
+private:
+    void updatePosition() noexcept
+    {
+        info.timeInSeconds = info.timeInSamples / sampleRate;
+        info.ppqPosition = info.timeInSamples / getSamplesPerQuarterNote();
+
+        auto quartersPerBar = info.timeSigNumerator * 4.0 / info.timeSigDenominator;
+        info.ppqPositionOfLastBarStart = std::floor(info.ppqPosition / quartersPerBar) * quartersPerBar;
+    }
+
+    CurrentPositionInfo info;
+    double sampleRate = 48000.0;
+};
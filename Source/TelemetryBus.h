@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    TelemetryBus.h
+
+    Lock free channel for what the audio thread did, read by the GUI.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Single producer, single consumer queue of small typed events. The audio
+    thread pushes, the message thread drains on its timer. If the GUI falls
+    behind, new events are dropped and counted instead of blocking the audio.
+
+    It is registered as an object in the MagicGUIState, so GUI items can find
+    it with getObjectWithType<TelemetryBus>("telemetry").
+*/
+class TelemetryBus
+{
+public:
+    struct Event
+    {
+        enum Type
+        {
+            stepHit,        //value is the note number
+            currentStep,    //value is the step index in the pattern
+            pulsesClamped   //value is the number of pulses played, 0 when not clamped
+        };
+
+        Type type;
+        int lane;
+        int value;
+    };
+
+    static constexpr int capacity = 4096;
+
+    TelemetryBus() = default;
+
+    //Audio thread
+    bool push(Event::Type type, int lane, int value) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+        {
+            numDropped.store(numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        events[start1] = { type, lane, value };
+        fifo.finishedWrite(1);
+        return true;
+    }
+
+    //Message thread, calls callback(const Event&) for everything pushed since the last drain
+    template <typename Callback>
+    void drain(Callback&& callback)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+        for (int i = 0; i < size1; ++i)
+            callback(events[start1 + i]);
+
+        for (int i = 0; i < size2; ++i)
+            callback(events[start2 + i]);
+
+        fifo.finishedRead(size1 + size2);
+    }
+
+    int getNumDropped() const noexcept { return numDropped.load(std::memory_order_relaxed); }
+
+private:
+    AbstractFifo fifo { capacity };
+    Event events[capacity];
+    std::atomic<int> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(TelemetryBus)
+};
@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    TripleBuffer.h
+
+    Lock free hand over of a value from one writer thread to one reader thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Three copies of a value, one owned by the writer, one by the reader and one
+    in the middle. Publishing and picking up a value are single atomic exchanges
+    of the middle index, so neither side ever waits or sees a half written value.
+
+    The writer always fills a buffer that may hold an older value, so it has to
+    write the whole value before publishing.
+*/
+template <typename Type>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    //Writer side
+    Type& getWriteBuffer() noexcept { return buffers[writeIndex]; }
+
+    void publish() noexcept
+    {
+        auto previous = middle.exchange(writeIndex | newDataFlag, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    //Reader side, returns true if a newer value was picked up
+    bool update() noexcept
+    {
+        if ((middle.load(std::memory_order_acquire) & newDataFlag) == 0)
+            return false;
+
+        auto previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+        return true;
+    }
+
+    const Type& getReadBuffer() const noexcept { return buffers[readIndex]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int newDataFlag = 4;
+
+    Type buffers[3];
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle { 2 };
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+};